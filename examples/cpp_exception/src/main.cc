@@ -1,7 +1,11 @@
 #include "logger.h"
 
-int test(int) {
-  throw std::runtime_error(EXCEPTION("An error occurred"));
+int test(int id) {
+  throw std::runtime_error(EXCEPTION("An error occurred, id %d", id));
+}
+
+int testBacktrace(int id) {
+  throw EXCEPTION_BT("Bad id %d", id);
 }
 
 int main() {
@@ -10,5 +14,11 @@ int main() {
   } catch (const std::exception &e) {
     LOGERROR("Caught exception: %s", e.what());
   }
+
+  try {
+    testBacktrace(42);
+  } catch (const std::exception &e) {
+    LOG_EXCEPTION(e);
+  }
   return 0;
-}
\ No newline at end of file
+}
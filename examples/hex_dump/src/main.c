@@ -0,0 +1,22 @@
+#include "logger.h"
+
+int main() {
+  unsigned char packet[100];
+  const char text[] = "GET /index.html HTTP/1.1";
+  int i;
+
+  for (i = 0; i < (int) sizeof(packet); i++) {
+    packet[i] = (unsigned char) (i * 7);
+  }
+
+  LOGDEBUG_HEX(text, sizeof(text) - 1);
+  LOGINFO_HEX(packet, sizeof(packet));
+
+  log_library_set_hex_limit(40);
+  LOGWARN_HEX(packet, sizeof(packet));
+
+  log_library_set_hex_mode(LOG_LIBRARY_HEX_COMPACT);
+  LOGERROR_HEX(packet, sizeof(packet));
+
+  return 0;
+}
@@ -0,0 +1,69 @@
+#include "config.h"
+#include "logger.h"
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define MAX_THREADS 4
+#define MAX_LOG_SIZE 200000
+
+struct Rotation {
+  log_library_logger *logger;
+  std::string prefix;
+  std::atomic<int> counter;
+};
+
+void maxFileSizeCallback(void *userdata) {
+  Rotation *rotation = (Rotation *) userdata;
+  std::string logFile = rotation->prefix + "." + std::to_string(++rotation->counter) + ".txt";
+
+  // Callback runs with the lock of this logger held
+  log_library_set_log_file_unlocked_l(rotation->logger, logFile.c_str());
+}
+
+int main() {
+  std::string log_dir(LOG_DIR);
+
+  log_library_logger *network = log_library_create((log_dir + "/network.0.txt").c_str());
+  log_library_logger *orders = log_library_create((log_dir + "/orders.0.txt").c_str());
+  if (!network || !orders) {
+    std::cerr << "Failed to create loggers\n";
+    return 1;
+  }
+
+  Rotation networkRotation = {network, log_dir + "/network", {0}};
+  Rotation ordersRotation = {orders, log_dir + "/orders", {0}};
+
+  log_library_set_log_max_size_l(network, MAX_LOG_SIZE);
+  log_library_set_max_file_size_callback_l(network, maxFileSizeCallback, &networkRotation);
+  log_library_set_log_max_size_l(orders, MAX_LOG_SIZE);
+  log_library_set_max_file_size_callback_l(orders, maxFileSizeCallback, &ordersRotation);
+
+  // Noisy network logger keeps warnings only, order logger keeps everything
+  log_library_set_level_l(network, LOG_LIBRARY_SEVERITY_WARN);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < MAX_THREADS; i++) {
+    threads.push_back(std::thread([=]() {
+      for (int j = 0; j < 10000; j++) {
+        LOGDEBUG_L(network, "Thread %d received packet %d", i, j);
+        if (j % 100 == 0) {
+          LOGWARN_L(network, "Thread %d retransmitted packet %d", i, j);
+        }
+        LOGINFO_L(orders, "Thread %d filled order %d", i, j);
+      }
+    }));
+  }
+
+  for (auto &thread: threads) {
+    thread.join();
+  }
+
+  LOGINFO("Network log rotated %d times, order log rotated %d times", networkRotation.counter.load(),
+          ordersRotation.counter.load());
+
+  log_library_destroy(network);
+  log_library_destroy(orders);
+}
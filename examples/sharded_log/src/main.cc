@@ -0,0 +1,72 @@
+#include "config.h"
+#include "logger.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define MAX_THREADS 10
+#define MAX_SHARD_SIZE 1000000
+
+static std::atomic<int> rotatedShards(0);
+
+// Called from the thread that owns the shard, no lock is held
+void maxShardSizeCallback(const char *closed_path, void *userdata) {
+  (void) closed_path;
+  (void) userdata;
+  rotatedShards++;
+}
+
+int main() {
+  std::string logFile = std::string(LOG_DIR) + "/sharded_log.txt";
+
+  log_library_set_sharded_log_file(logFile.c_str());
+  log_library_set_log_max_size(MAX_SHARD_SIZE);
+  log_library_set_max_shard_size_callback(maxShardSizeCallback, NULL);
+
+  auto start = std::chrono::high_resolution_clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < MAX_THREADS; i++) {
+    threads.push_back(std::thread([i]() {
+      for (int j = 0; j < 10000; j++) {
+        LOGDEBUG("Thread %d message %d", i, j);
+        LOGINFO("Thread %d message %d", i, j);
+        LOGERROR("Thread %d message %d", i, j);
+        LOGWARN("Thread %d message %d", i, j);
+      }
+      log_library_close_shard();
+    }));
+  }
+
+  for (auto &thread: threads) {
+    thread.join();
+  }
+
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> elapsed = end - start;
+  std::cout << "Elapsed time: " << elapsed.count() << "s\n";
+  log_library_set_sharded_log_file(NULL);
+
+  // Same as logger_merge tool
+  log_library_merge *merge = log_library_merge_open(logFile.c_str());
+  std::string previous;
+  size_t records = 0;
+  size_t unordered = 0;
+  size_t size;
+  const char *record;
+  while ((record = log_library_merge_next(merge, &size)) != NULL) {
+    std::string time(record, size < LOG_LIBRARY_TIME_LENGTH ? size : LOG_LIBRARY_TIME_LENGTH);
+    if (time < previous) {
+      unordered++;
+    }
+    previous = time;
+    records++;
+  }
+  log_library_merge_close(merge);
+
+  std::cout << "Merged records: " << records << " unordered: " << unordered << " rotated shards: " << rotatedShards << "\n";
+  return 0;
+}
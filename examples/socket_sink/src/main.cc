@@ -0,0 +1,80 @@
+#include "config.h"
+#include "logger.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#define MAX_RECORDS 10000
+
+// Local test server that stands in for log agent, reads RFC5424 records with octet counting framing
+static void agentServer(int server_fd, std::atomic<int> *received) {
+  int client_fd = accept(server_fd, NULL, NULL);
+  std::string data;
+  char buffer[4096];
+  ssize_t size;
+
+  while ((size = read(client_fd, buffer, sizeof(buffer))) > 0) {
+    data.append(buffer, size);
+    size_t position = 0;
+    size_t space;
+    while ((space = data.find(' ', position)) != std::string::npos) {
+      size_t length = std::stoul(data.substr(position, space - position));
+      if (data.size() < space + 1 + length) {
+        break;
+      }
+      if (*received < 3) {
+        std::cout << "agent: " << data.substr(space + 1, length) << "\n";
+      }
+      (*received)++;
+      position = space + 1 + length;
+    }
+    data.erase(0, position);
+  }
+  close(client_fd);
+}
+
+int main() {
+  std::string path = std::string(LOG_DIR) + "/agent.sock";
+  unlink(path.c_str());
+
+  // Agent is not started yet, records are buffered
+  log_library_set_socket(path.c_str(), LOG_LIBRARY_SOCKET_STREAM, LOG_LIBRARY_FRAMING_RFC5424, "socket_sink");
+  log_library_set_socket_batch(64);
+  log_library_set_socket_max_delay(50);
+  LOGINFO("Logged before agent started");
+
+  int server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  snprintf(address.sun_path, sizeof(address.sun_path), "%s", path.c_str());
+  bind(server_fd, (struct sockaddr *) &address, sizeof(address));
+  listen(server_fd, 1);
+
+  std::atomic<int> received(0);
+  std::thread agent(agentServer, server_fd, &received);
+
+  // Wait for reconnect backoff
+  std::this_thread::sleep_for(std::chrono::milliseconds(LOG_LIBRARY_SOCKET_MIN_BACKOFF_MS * 2));
+
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < MAX_RECORDS; i++) {
+    LOGDEBUG("Record %d", i);
+  }
+  log_library_flush_log();
+  auto end = std::chrono::high_resolution_clock::now();
+
+  log_library_socket_stats stats;
+  log_library_get_socket_stats(&stats);
+  log_library_close_socket();
+  agent.join();
+  close(server_fd);
+  unlink(path.c_str());
+
+  std::chrono::duration<double> elapsed = end - start;
+  std::cout << "Elapsed time: " << elapsed.count() << "s\n";
+  std::cout << "Sent: " << stats.sent << " dropped: " << stats.dropped << " reconnects: " << stats.reconnects
+            << " pending: " << stats.pending << " received: " << received << "\n";
+  return 0;
+}
@@ -0,0 +1,34 @@
+#include "logger.h"
+#include <string>
+#include <thread>
+#include <vector>
+
+#define MAX_THREADS 4
+
+void handleRequest(unsigned long long request_id) {
+  LOG_CONTEXT("req", "%llu", request_id);
+  LOGINFO("Request started");
+  LOGDEBUG("Request finished");
+}
+
+int main() {
+  std::vector<std::thread> threads;
+  for (int i = 0; i < MAX_THREADS; i++) {
+    threads.push_back(std::thread([i]() {
+      log_library_context_set_thread_name(("worker-" + std::to_string(i)).c_str());
+      log_library_context_push("tenant", "tenant-%d", i % 2);
+      for (unsigned long long j = 0; j < 3; j++) {
+        handleRequest(i * 100 + j);
+      }
+      log_library_context_pop();
+      LOGWARN("Worker done");
+    }));
+  }
+
+  for (auto &thread: threads) {
+    thread.join();
+  }
+
+  LOGINFO("Message without context");
+  return 0;
+}
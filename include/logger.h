@@ -11,11 +11,72 @@
 #if defined(_WIN32) || defined(_WIN64)
 #include <windows.h>
 #else
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <pthread.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define LOG_LIBRARY_SOCKET_SUPPORT
+#if defined(__linux__) && defined(_GNU_SOURCE)
+#define LOG_LIBRARY_SENDMMSG
+#endif
+#endif
+
+#ifndef LOG_LIBRARY_DISABLE_SIMD
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LOG_LIBRARY_HEX_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define LOG_LIBRARY_HEX_NEON
+#include <arm_neon.h>
+#endif
 #endif
 
 #define LOG_LIBRFARY_TIME_BUFFER_SIZE 30
 #define LOG_LIBRFARY_UINT_BUFFER_SIZE 12
+#define LOG_LIBRARY_CONTEXT_MAX_ENTRIES 8
+#define LOG_LIBRARY_CONTEXT_NAME_SIZE 32
+#define LOG_LIBRARY_CONTEXT_KEY_SIZE 32
+#define LOG_LIBRARY_CONTEXT_VALUE_SIZE 64
+#define LOG_LIBRARY_CONTEXT_PREFIX_SIZE 512
+#define LOG_LIBRARY_HEX_BUFFER_SIZE 1024
+#define LOG_LIBRARY_HEX_LINE_SIZE 80
+#define LOG_LIBRARY_HEX_DEFAULT_LIMIT 4096
+#define LOG_LIBRARY_HEX_CLASSIC 0
+#define LOG_LIBRARY_HEX_COMPACT 1
+#define LOG_LIBRARY_EXCEPTION_BUFFER_SIZE 1024
+#define LOG_LIBRARY_EXCEPTION_MAX_FRAMES 32
+#define LOG_LIBRARY_EXCEPTION_FRAME_SIZE 512
+#define LOG_LIBRARY_SOCKET_BUFFER_SIZE 65536
+#define LOG_LIBRARY_SOCKET_RECORD_SIZE 4096
+#define LOG_LIBRARY_SOCKET_MAX_RECORDS 256
+#define LOG_LIBRARY_SOCKET_DEFAULT_BATCH 64
+#define LOG_LIBRARY_SOCKET_DEFAULT_MAX_DELAY_MS 100
+#define LOG_LIBRARY_SOCKET_HEADER_SIZE 128
+#define LOG_LIBRARY_SOCKET_MIN_BACKOFF_MS 100
+#define LOG_LIBRARY_SOCKET_MAX_BACKOFF_MS 5000
+#define LOG_LIBRARY_SOCKET_CLOSE_TIMEOUT_MS 100
+#define LOG_LIBRARY_SOCKET_STREAM 0
+#define LOG_LIBRARY_SOCKET_DGRAM 1
+#define LOG_LIBRARY_FRAMING_NONE 0
+#define LOG_LIBRARY_FRAMING_RFC5424 1
+#define LOG_LIBRARY_SHARD_PATH_SIZE 1024
+#define LOG_LIBRARY_SHARD_RETRY_SECONDS 1
+#define LOG_LIBRARY_MERGE_LINE_SIZE 1024
+#define LOG_LIBRARY_MERGE_MAX_SHARDS 1024
+
+// Time prefix of every record, "year-month-day hours:minutes:seconds.nanoseconds"
+#define LOG_LIBRARY_TIME_LENGTH 29
+
+// Syslog severities, used by RFC5424 framing
+#define LOG_LIBRARY_SEVERITY_ERROR 3
+#define LOG_LIBRARY_SEVERITY_WARN 4
+#define LOG_LIBRARY_SEVERITY_INFO 6
+#define LOG_LIBRARY_SEVERITY_DEBUG 7
 #ifdef LOG_LIBRARY_PRETTY_FUNCTION
 #define LOG_LIBRARY_FUNC_NAME __PRETTY_FUNCTION__
 #else
@@ -23,6 +84,25 @@
 #endif
 #define LOG_LIBRARY_LINE __LINE__
 
+#if defined(_MSC_VER)
+#define LOG_LIBRARY_THREAD_LOCAL __declspec(thread)
+#else
+#define LOG_LIBRARY_THREAD_LOCAL __thread
+#endif
+
+// Settings that are read without the logger lock, acquire/release variants also publish data written before the store
+#if defined(_MSC_VER)
+#define LOG_LIBRARY_ATOMIC_LOAD(ptr) (*(volatile long *) (ptr))
+#define LOG_LIBRARY_ATOMIC_STORE(ptr, value) InterlockedExchange((volatile long *) (ptr), (long) (value))
+#define LOG_LIBRARY_ATOMIC_LOAD_ACQUIRE(ptr) InterlockedCompareExchange((volatile long *) (ptr), 0, 0)
+#define LOG_LIBRARY_ATOMIC_STORE_RELEASE(ptr, value) InterlockedExchange((volatile long *) (ptr), (long) (value))
+#else
+#define LOG_LIBRARY_ATOMIC_LOAD(ptr) __atomic_load_n(ptr, __ATOMIC_RELAXED)
+#define LOG_LIBRARY_ATOMIC_STORE(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_RELAXED)
+#define LOG_LIBRARY_ATOMIC_LOAD_ACQUIRE(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define LOG_LIBRARY_ATOMIC_STORE_RELEASE(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_RELEASE)
+#endif
+
 #ifndef LOG_LIBRARY_DISABLE_COLORS
 #define COLOR_RESET "\033[0m"
 #define COLOR_BLUE "\033[34m"
@@ -37,34 +117,136 @@
 #define COLOR_RED ""
 #endif
 
-// Define a mutex for thread safety
+// Define a mutex for thread safety, every logger has its own
 #if defined(_WIN32) || defined(_WIN64)
-static HANDLE log_library_mutex = NULL;
-#define LOG_LIBRARY_LOCK()                                \
-  do {                                                    \
-    if (!log_library_mutex) {                             \
-      log_library_mutex = CreateMutex(NULL, FALSE, NULL); \
-    }                                                     \
-    WaitForSingleObject(log_library_mutex, INFINITE);     \
+typedef HANDLE log_library_mutex_t;
+#define LOG_LIBRARY_MUTEX_INITIALIZER NULL
+#define LOG_LIBRARY_LOCK_L(logger)                      \
+  do {                                                  \
+    if (!(logger)->mutex) {                             \
+      (logger)->mutex = CreateMutex(NULL, FALSE, NULL); \
+    }                                                   \
+    WaitForSingleObject((logger)->mutex, INFINITE);     \
   } while (0)
-#define LOG_LIBRARY_UNLOCK() ReleaseMutex(log_library_mutex)
+#define LOG_LIBRARY_UNLOCK_L(logger) ReleaseMutex((logger)->mutex)
 #define LOG_LIBRARY_SHORT_FILE (strrchr(__FILE__, '\\') ? strrchr(__FILE__, '\\') + 1 : __FILE__)
 #else
-static pthread_mutex_t log_library_mutex = PTHREAD_MUTEX_INITIALIZER;
-#define LOG_LIBRARY_LOCK() pthread_mutex_lock(&log_library_mutex)
-#define LOG_LIBRARY_UNLOCK() pthread_mutex_unlock(&log_library_mutex)
+typedef pthread_mutex_t log_library_mutex_t;
+#define LOG_LIBRARY_MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define LOG_LIBRARY_LOCK_L(logger) pthread_mutex_lock(&(logger)->mutex)
+#define LOG_LIBRARY_UNLOCK_L(logger) pthread_mutex_unlock(&(logger)->mutex)
 #define LOG_LIBRARY_SHORT_FILE (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
 #endif
 
-
-// Static log file pointer, defaults to stderr
-static FILE *log_library_log_file = NULL;
-static unsigned int log_library_log_size = 0;
-static unsigned int log_library_log_max_size = 0;
+// Lock of the default logger, also guards global settings
+#define LOG_LIBRARY_LOCK() LOG_LIBRARY_LOCK_L(&log_library_default_logger)
+#define LOG_LIBRARY_UNLOCK() LOG_LIBRARY_UNLOCK_L(&log_library_default_logger)
 
 typedef void (*log_library_callback)(void *userdata);
-static log_library_callback log_library_max_file_size_callback = NULL;
-static void *log_library_userdata = NULL;
+
+typedef struct {
+  unsigned long sent;
+  unsigned long dropped;
+  unsigned long reconnects;
+  unsigned long pending;
+} log_library_socket_stats;
+
+#ifdef LOG_LIBRARY_SOCKET_SUPPORT
+// UNIX socket sink, records are packed in one buffer and sent in batches
+typedef struct {
+  int fd;
+  int type;
+  int framing;
+  int connected_once;
+  struct sockaddr_un address;
+  unsigned int batch;
+  unsigned int max_delay_ms;
+  uint64_t oldest_at;
+  int record_severity;
+  unsigned int backoff_ms;
+  uint64_t retry_at;
+  char header[LOG_LIBRARY_SOCKET_HEADER_SIZE];
+  size_t used;
+  size_t record_start;
+  int record_open;
+  size_t head_skip;
+  unsigned int count;
+  size_t offsets[LOG_LIBRARY_SOCKET_MAX_RECORDS];
+  size_t sizes[LOG_LIBRARY_SOCKET_MAX_RECORDS];
+  log_library_socket_stats stats;
+  char buffer[LOG_LIBRARY_SOCKET_BUFFER_SIZE];
+} log_library_socket_sink;
+#endif
+
+// Logger with its own output, level, file size limit, hex dump settings and lock.
+// Log file defaults to stderr, socket sink replaces file and stderr output while it is set.
+// Level and hex dump settings are accessed atomically, macros check the level before taking the lock.
+typedef struct {
+  FILE *log_file;
+  unsigned int log_size;
+  unsigned int log_max_size;
+  log_library_callback max_file_size_callback;
+  void *userdata;
+  int log_level;
+  unsigned int hex_limit;
+  int hex_mode;
+  log_library_mutex_t mutex;
+#ifdef LOG_LIBRARY_SOCKET_SUPPORT
+  log_library_socket_sink *socket;
+  log_library_socket_stats socket_stats;
+#endif
+} log_library_logger;
+
+// Logger used by macros without _L suffix
+static log_library_logger log_library_default_logger = {
+    NULL, 0, 0, NULL, NULL, LOG_LIBRARY_SEVERITY_DEBUG, LOG_LIBRARY_HEX_DEFAULT_LIMIT, LOG_LIBRARY_HEX_CLASSIC,
+    LOG_LIBRARY_MUTEX_INITIALIZER
+#ifdef LOG_LIBRARY_SOCKET_SUPPORT
+    , NULL, {0, 0, 0, 0}
+#endif
+};
+
+// Per-thread logging context, the prefix is rendered only when the context changes
+typedef struct {
+  char thread_name[LOG_LIBRARY_CONTEXT_NAME_SIZE];
+  char keys[LOG_LIBRARY_CONTEXT_MAX_ENTRIES][LOG_LIBRARY_CONTEXT_KEY_SIZE];
+  char values[LOG_LIBRARY_CONTEXT_MAX_ENTRIES][LOG_LIBRARY_CONTEXT_VALUE_SIZE];
+  unsigned int depth;
+  char prefix[LOG_LIBRARY_CONTEXT_PREFIX_SIZE];
+} log_library_context;
+
+static LOG_LIBRARY_THREAD_LOCAL log_library_context log_library_thread_context;
+
+typedef void (*log_library_shard_callback)(const char *closed_path, void *userdata);
+typedef void (*log_library_shard_visitor)(void *userdata, unsigned int shard, unsigned int generation);
+
+// Sharded log file of one thread, written without the global lock
+typedef struct {
+  FILE *file;
+  unsigned int shard;
+  unsigned int generation;
+  unsigned int size;
+  unsigned int epoch;
+  time_t retry_at;
+  char base_path[LOG_LIBRARY_SHARD_PATH_SIZE];
+} log_library_shard;
+
+static LOG_LIBRARY_THREAD_LOCAL log_library_shard log_library_thread_shard;
+// Enabled flag and epoch are read without the lock, everything else is guarded by the default logger lock
+static int log_library_shard_enabled = 0;
+static unsigned int log_library_shard_epoch = 0;
+static unsigned int log_library_shard_counter = 0;
+static char log_library_shard_path[LOG_LIBRARY_SHARD_PATH_SIZE];
+static log_library_shard_callback log_library_max_shard_size_callback = NULL;
+static void *log_library_shard_userdata = NULL;
+#if !defined(_WIN32) && !defined(_WIN64)
+static pthread_key_t log_library_shard_key;
+static int log_library_shard_key_created = 0;
+#endif
+
+// Logger instances
+static inline log_library_logger *log_library_create(const char *file_path);
+static inline void log_library_destroy(log_library_logger *logger);
 
 // Safe functions
 static inline void log_library_set_log_file(const char *file_path);
@@ -73,6 +255,53 @@ static inline unsigned int log_library_get_log_size();
 static inline void log_library_close_log_file();
 static inline void log_library_set_max_file_size_callback(log_library_callback callback, void *userdata);
 static inline void log_library_flush_log();
+static inline void log_library_set_level(int level);
+static inline void log_library_set_hex_limit(unsigned int limit);
+static inline void log_library_set_hex_mode(int mode);
+static inline void log_library_set_socket(const char *path, int type, int framing, const char *app_name);
+static inline void log_library_set_socket_batch(unsigned int records);
+static inline void log_library_set_socket_max_delay(unsigned int max_delay_ms);
+static inline void log_library_close_socket();
+static inline void log_library_get_socket_stats(log_library_socket_stats *stats);
+static inline void log_library_set_sharded_log_file(const char *file_path);
+static inline void log_library_set_max_shard_size_callback(log_library_shard_callback callback, void *userdata);
+
+// Shard functions of the calling thread (no lock needed)
+static inline unsigned int log_library_get_shard_size();
+static inline void log_library_close_shard();
+
+// Shard merge functions, records of all shards are returned ordered by time
+typedef struct log_library_merge log_library_merge;
+static inline log_library_merge *log_library_merge_open(const char *file_path);
+static inline const char *log_library_merge_next(log_library_merge *merge, size_t *size);
+static inline void log_library_merge_close(log_library_merge *merge);
+
+// Thread context functions (no lock needed, the context is thread local)
+static inline void log_library_context_set_thread_name(const char *name);
+static inline void log_library_context_push(const char *key, const char *fmt, ...);
+static inline void log_library_context_vpush(const char *key, const char *fmt, va_list argptr);
+static inline void log_library_context_pop();
+static inline void log_library_context_clear();
+static inline unsigned int log_library_context_size();
+static inline const char *log_library_context_key(unsigned int index);
+static inline const char *log_library_context_value(unsigned int index);
+static inline const char *log_library_context_thread_name();
+
+// Safe functions of logger instance
+static inline void log_library_set_log_file_l(log_library_logger *logger, const char *file_path);
+static inline void log_library_set_log_max_size_l(log_library_logger *logger, unsigned int max_size);
+static inline unsigned int log_library_get_log_size_l(log_library_logger *logger);
+static inline void log_library_close_log_file_l(log_library_logger *logger);
+static inline void log_library_set_max_file_size_callback_l(log_library_logger *logger, log_library_callback callback, void *userdata);
+static inline void log_library_flush_log_l(log_library_logger *logger);
+static inline void log_library_set_level_l(log_library_logger *logger, int level);
+static inline void log_library_set_hex_limit_l(log_library_logger *logger, unsigned int limit);
+static inline void log_library_set_hex_mode_l(log_library_logger *logger, int mode);
+static inline void log_library_set_socket_l(log_library_logger *logger, const char *path, int type, int framing, const char *app_name);
+static inline void log_library_set_socket_batch_l(log_library_logger *logger, unsigned int records);
+static inline void log_library_set_socket_max_delay_l(log_library_logger *logger, unsigned int max_delay_ms);
+static inline void log_library_close_socket_l(log_library_logger *logger);
+static inline void log_library_get_socket_stats_l(log_library_logger *logger, log_library_socket_stats *stats);
 
 // Unlocked functions
 static inline void log_library_set_log_file_unlocked(const char *file_path);
@@ -81,78 +310,204 @@ static inline unsigned int log_library_get_log_size_unlocked();
 static inline void log_library_close_log_file_unlocked();
 static inline void log_library_set_max_file_size_callback_unlocked(log_library_callback callback, void *userdata);
 static inline void log_library_flush_log_unlocked();
+static inline void log_library_set_hex_limit_unlocked(unsigned int limit);
+static inline void log_library_set_hex_mode_unlocked(int mode);
+static inline void log_library_set_socket_unlocked(const char *path, int type, int framing, const char *app_name);
+static inline void log_library_set_socket_batch_unlocked(unsigned int records);
+static inline void log_library_set_socket_max_delay_unlocked(unsigned int max_delay_ms);
+static inline void log_library_close_socket_unlocked();
+static inline void log_library_get_socket_stats_unlocked(log_library_socket_stats *stats);
+static inline void log_library_set_sharded_log_file_unlocked(const char *file_path);
+static inline void log_library_set_max_shard_size_callback_unlocked(log_library_shard_callback callback, void *userdata);
+
+// Unlocked functions of logger instance
+static inline void log_library_set_log_file_unlocked_l(log_library_logger *logger, const char *file_path);
+static inline void log_library_set_log_max_size_unlocked_l(log_library_logger *logger, unsigned int max_size);
+static inline unsigned int log_library_get_log_size_unlocked_l(log_library_logger *logger);
+static inline void log_library_close_log_file_unlocked_l(log_library_logger *logger);
+static inline void log_library_set_max_file_size_callback_unlocked_l(log_library_logger *logger, log_library_callback callback, void *userdata);
+static inline void log_library_set_hex_limit_unlocked_l(log_library_logger *logger, unsigned int limit);
+static inline void log_library_set_hex_mode_unlocked_l(log_library_logger *logger, int mode);
+static inline void log_library_flush_log_unlocked_l(log_library_logger *logger);
+static inline void log_library_set_socket_unlocked_l(log_library_logger *logger, const char *path, int type, int framing, const char *app_name);
+static inline void log_library_set_socket_batch_unlocked_l(log_library_logger *logger, unsigned int records);
+static inline void log_library_set_socket_max_delay_unlocked_l(log_library_logger *logger, unsigned int max_delay_ms);
+static inline void log_library_close_socket_unlocked_l(log_library_logger *logger);
+static inline void log_library_get_socket_stats_unlocked_l(log_library_logger *logger, log_library_socket_stats *stats);
 
 // Private functions
 static inline void log_library_format_current_time(char *buffer, size_t buffer_size);
-static inline void log_library_log_message(const char *color, const char *fmt, ...);
+static inline int log_library_logger_level(const log_library_logger *logger);
+static inline void log_library_log_message(log_library_logger *logger, const char *color, int severity, const char *fmt, ...);
+static inline void log_library_log_hex(log_library_logger *logger, const char *color, int severity, const void *data, size_t size, const char *fmt, ...);
+static inline void log_library_sink_write(log_library_logger *logger, FILE *output, const char *data, size_t size);
+static inline void log_library_sink_vprintf(log_library_logger *logger, FILE *output, const char *fmt, va_list argptr);
+static inline void log_library_sink_printf(log_library_logger *logger, FILE *output, const char *fmt, ...);
+static inline void log_library_update_log_size_unlocked(log_library_logger *logger, FILE *output);
+static inline FILE *log_library_shard_begin();
+static inline void log_library_shard_end(FILE *output);
+static inline void log_library_hex_encode(char *dst, const unsigned char *src, size_t size);
+static inline size_t log_library_hex_line(char *dst, size_t offset, const unsigned char *src, size_t size);
+static inline void log_library_context_render();
+static inline const char *log_library_context_prefix();
+
+// Creates logger that writes to file_path, NULL file_path means stderr. Returns NULL on allocation failure.
+static inline log_library_logger *log_library_create(const char *file_path) {
+  log_library_logger *logger = (log_library_logger *) calloc(1, sizeof(log_library_logger));
+  if (!logger) {
+    return NULL;
+  }
+  logger->log_level = LOG_LIBRARY_SEVERITY_DEBUG;
+  logger->hex_limit = LOG_LIBRARY_HEX_DEFAULT_LIMIT;
+  logger->hex_mode = LOG_LIBRARY_HEX_CLASSIC;
+#if defined(_WIN32) || defined(_WIN64)
+  logger->mutex = CreateMutex(NULL, FALSE, NULL);
+#else
+  pthread_mutex_init(&logger->mutex, NULL);
+#endif
+  if (file_path) {
+    log_library_set_log_file_unlocked_l(logger, file_path);
+  }
+  return logger;
+}
+
+// Sends pending records, closes log file and frees logger
+static inline void log_library_destroy(log_library_logger *logger) {
+  if (!logger || logger == &log_library_default_logger) {
+    return;
+  }
+  log_library_close_socket_unlocked_l(logger);
+  log_library_flush_log_unlocked_l(logger);
+  log_library_close_log_file_unlocked_l(logger);
+#if defined(_WIN32) || defined(_WIN64)
+  CloseHandle(logger->mutex);
+#else
+  pthread_mutex_destroy(&logger->mutex);
+#endif
+  free(logger);
+}
 
 // Sets the log file. If not set, logs default to stderr.
 static inline void log_library_set_log_file(const char *file_path) {
-  LOG_LIBRARY_LOCK();
-  log_library_set_log_file_unlocked(file_path);
-  LOG_LIBRARY_UNLOCK();
+  log_library_set_log_file_l(&log_library_default_logger, file_path);
 }
 
 static inline void log_library_set_log_file_unlocked(const char *file_path) {
-  if (log_library_log_file && log_library_log_file != stderr) {
-    fclose(log_library_log_file);
-    log_library_log_size = 0;
+  log_library_set_log_file_unlocked_l(&log_library_default_logger, file_path);
+}
+
+static inline void log_library_set_log_file_l(log_library_logger *logger, const char *file_path) {
+  LOG_LIBRARY_LOCK_L(logger);
+  log_library_set_log_file_unlocked_l(logger, file_path);
+  LOG_LIBRARY_UNLOCK_L(logger);
+}
+
+static inline void log_library_set_log_file_unlocked_l(log_library_logger *logger, const char *file_path) {
+  if (logger->log_file && logger->log_file != stderr) {
+    fclose(logger->log_file);
+    logger->log_size = 0;
   }
-  log_library_log_file = fopen(file_path, "a");
-  if (!log_library_log_file) {
-    log_library_log_file = stderr;
+  logger->log_file = fopen(file_path, "a");
+  if (!logger->log_file) {
+    logger->log_file = stderr;
   } else {
-    fseek(log_library_log_file, 0, SEEK_END);
-    log_library_log_size = ftell(log_library_log_file);
-    fseek(log_library_log_file, 0, SEEK_SET);
+    fseek(logger->log_file, 0, SEEK_END);
+    logger->log_size = ftell(logger->log_file);
+    fseek(logger->log_file, 0, SEEK_SET);
   }
 }
 
 static inline void log_library_set_log_max_size(unsigned int max_size) {
-  LOG_LIBRARY_LOCK();
-  log_library_set_log_max_size_unlocked(max_size);
-  LOG_LIBRARY_UNLOCK();
+  log_library_set_log_max_size_l(&log_library_default_logger, max_size);
 }
 
 static inline void log_library_set_log_max_size_unlocked(unsigned int max_size) {
-  log_library_log_max_size = max_size;
+  log_library_set_log_max_size_unlocked_l(&log_library_default_logger, max_size);
 }
 
+static inline void log_library_set_log_max_size_l(log_library_logger *logger, unsigned int max_size) {
+  LOG_LIBRARY_LOCK_L(logger);
+  log_library_set_log_max_size_unlocked_l(logger, max_size);
+  LOG_LIBRARY_UNLOCK_L(logger);
+}
+
+static inline void log_library_set_log_max_size_unlocked_l(log_library_logger *logger, unsigned int max_size) {
+  // Read by sharded records without the lock
+  LOG_LIBRARY_ATOMIC_STORE(&logger->log_max_size, max_size);
+}
 
 static inline unsigned int log_library_get_log_size() {
-  LOG_LIBRARY_LOCK();
-  unsigned int size = log_library_get_log_size_unlocked();
-  LOG_LIBRARY_UNLOCK();
-  return size;
+  return log_library_get_log_size_l(&log_library_default_logger);
 }
 
 static inline unsigned int log_library_get_log_size_unlocked() {
-  return log_library_log_size;
+  return log_library_get_log_size_unlocked_l(&log_library_default_logger);
+}
+
+static inline unsigned int log_library_get_log_size_l(log_library_logger *logger) {
+  LOG_LIBRARY_LOCK_L(logger);
+  unsigned int size = log_library_get_log_size_unlocked_l(logger);
+  LOG_LIBRARY_UNLOCK_L(logger);
+  return size;
+}
+
+static inline unsigned int log_library_get_log_size_unlocked_l(log_library_logger *logger) {
+  return logger->log_size;
 }
 
 static inline void log_library_close_log_file() {
-  LOG_LIBRARY_LOCK();
-  log_library_close_log_file_unlocked();
-  LOG_LIBRARY_UNLOCK();
+  log_library_close_log_file_l(&log_library_default_logger);
 }
 
 static inline void log_library_close_log_file_unlocked() {
-  if (log_library_log_file && log_library_log_file != stderr) {
-    fclose(log_library_log_file);
-    log_library_log_file = NULL;
-    log_library_log_size = 0;
+  log_library_close_log_file_unlocked_l(&log_library_default_logger);
+}
+
+static inline void log_library_close_log_file_l(log_library_logger *logger) {
+  LOG_LIBRARY_LOCK_L(logger);
+  log_library_close_log_file_unlocked_l(logger);
+  LOG_LIBRARY_UNLOCK_L(logger);
+}
+
+static inline void log_library_close_log_file_unlocked_l(log_library_logger *logger) {
+  if (logger->log_file && logger->log_file != stderr) {
+    fclose(logger->log_file);
+    logger->log_file = NULL;
+    logger->log_size = 0;
   }
 }
 
 static inline void log_library_set_max_file_size_callback(log_library_callback callback, void *userdata) {
-  LOG_LIBRARY_LOCK();
-  log_library_set_max_file_size_callback_unlocked(callback, userdata);
-  LOG_LIBRARY_UNLOCK();
+  log_library_set_max_file_size_callback_l(&log_library_default_logger, callback, userdata);
 }
 
 static inline void log_library_set_max_file_size_callback_unlocked(log_library_callback callback, void *userdata) {
-  log_library_max_file_size_callback = callback;
-  log_library_userdata = userdata;
+  log_library_set_max_file_size_callback_unlocked_l(&log_library_default_logger, callback, userdata);
+}
+
+static inline void log_library_set_max_file_size_callback_l(log_library_logger *logger, log_library_callback callback, void *userdata) {
+  LOG_LIBRARY_LOCK_L(logger);
+  log_library_set_max_file_size_callback_unlocked_l(logger, callback, userdata);
+  LOG_LIBRARY_UNLOCK_L(logger);
+}
+
+static inline void log_library_set_max_file_size_callback_unlocked_l(log_library_logger *logger, log_library_callback callback, void *userdata) {
+  logger->max_file_size_callback = callback;
+  logger->userdata = userdata;
+}
+
+// Messages less severe than level are skipped at runtime, e.g. LOG_LIBRARY_SEVERITY_WARN keeps WARN and ERROR
+static inline void log_library_set_level(int level) {
+  log_library_set_level_l(&log_library_default_logger, level);
+}
+
+static inline void log_library_set_level_l(log_library_logger *logger, int level) {
+  LOG_LIBRARY_ATOMIC_STORE(&logger->log_level, level);
+}
+
+// Level is read by macros without the logger lock
+static inline int log_library_logger_level(const log_library_logger *logger) {
+  return LOG_LIBRARY_ATOMIC_LOAD(&logger->log_level);
 }
 
 static inline void log_library_format_current_time(char *buffer, size_t buffer_size) {
@@ -193,160 +548,1769 @@ static inline void log_library_format_current_time(char *buffer, size_t buffer_s
            ts.tv_nsec);
 }
 
-// Function to print log message
-static inline void log_library_log_message(const char *color, const char *fmt, ...) {
-  LOG_LIBRARY_LOCK();
-  va_list argptr;
-  va_start(argptr, fmt);
+#ifdef LOG_LIBRARY_SOCKET_SUPPORT
+static inline uint64_t log_library_monotonic_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
 
-  FILE *output = log_library_log_file ? log_library_log_file : stderr;
-  int is_terminal = output == stderr;
+static inline void log_library_socket_disconnect(log_library_socket_sink *sink) {
+  if (sink->fd >= 0) {
+    close(sink->fd);
+    sink->fd = -1;
+  }
+  sink->head_skip = 0;
+  sink->retry_at = log_library_monotonic_ms() + sink->backoff_ms;
+  sink->backoff_ms = sink->backoff_ms * 2 < LOG_LIBRARY_SOCKET_MAX_BACKOFF_MS ? sink->backoff_ms * 2 : LOG_LIBRARY_SOCKET_MAX_BACKOFF_MS;
+}
 
-  if (is_terminal) {
-    fprintf(output, "%s", color);
-    vfprintf(output, fmt, argptr);
-    fprintf(output, "%s", COLOR_RESET);
-  } else {
-    vfprintf(output, fmt, argptr);
-    log_library_log_size = ftell(output);
-    if (log_library_log_max_size != 0 && log_library_log_size >= log_library_log_max_size) {
-      if (log_library_max_file_size_callback) {
-        log_library_max_file_size_callback(log_library_userdata);
+static inline int log_library_socket_connect(log_library_socket_sink *sink) {
+  int type = sink->type == LOG_LIBRARY_SOCKET_DGRAM ? SOCK_DGRAM : SOCK_STREAM;
+  int flags;
+
+  sink->fd = socket(AF_UNIX, type, 0);
+  if (sink->fd < 0) {
+    log_library_socket_disconnect(sink);
+    return -1;
+  }
+  fcntl(sink->fd, F_SETFD, FD_CLOEXEC);
+  flags = fcntl(sink->fd, F_GETFL, 0);
+  fcntl(sink->fd, F_SETFL, flags | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+  flags = 1;
+  setsockopt(sink->fd, SOL_SOCKET, SO_NOSIGPIPE, &flags, sizeof(flags));
+#endif
+  if (connect(sink->fd, (const struct sockaddr *) &sink->address, sizeof(sink->address)) != 0) {
+    log_library_socket_disconnect(sink);
+    return -1;
+  }
+  if (sink->connected_once) {
+    sink->stats.reconnects++;
+  }
+  sink->connected_once = 1;
+  sink->backoff_ms = LOG_LIBRARY_SOCKET_MIN_BACKOFF_MS;
+  return 0;
+}
+
+// Removes first count records from the buffer
+static inline void log_library_socket_consume(log_library_socket_sink *sink, unsigned int count, unsigned int sent) {
+  size_t start = count < sink->count ? sink->offsets[count] : sink->used;
+  unsigned int i;
+
+  if (count == 0) {
+    return;
+  }
+  memmove(sink->buffer, sink->buffer + start, sink->used - start);
+  sink->used -= start;
+  for (i = count; i < sink->count; i++) {
+    sink->offsets[i - count] = sink->offsets[i] - start;
+    sink->sizes[i - count] = sink->sizes[i];
+  }
+  sink->count -= count;
+  sink->stats.sent += sent;
+  sink->stats.dropped += count - sent;
+}
+
+static inline int log_library_socket_would_block(int error) {
+  return error == EAGAIN || error == EWOULDBLOCK || error == ENOBUFS || error == EINTR;
+}
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// Every record is one datagram
+static inline void log_library_socket_send_dgram(log_library_socket_sink *sink) {
+#ifdef LOG_LIBRARY_SENDMMSG
+  struct mmsghdr messages[LOG_LIBRARY_SOCKET_MAX_RECORDS];
+  struct iovec iov[LOG_LIBRARY_SOCKET_MAX_RECORDS];
+  unsigned int i;
+  int sent;
+
+  while (sink->count > 0) {
+    memset(messages, 0, sizeof(messages[0]) * sink->count);
+    for (i = 0; i < sink->count; i++) {
+      iov[i].iov_base = sink->buffer + sink->offsets[i];
+      iov[i].iov_len = sink->sizes[i];
+      messages[i].msg_hdr.msg_iov = &iov[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    sent = sendmmsg(sink->fd, messages, sink->count, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent > 0) {
+      log_library_socket_consume(sink, (unsigned int) sent, (unsigned int) sent);
+      continue;
+    }
+    if (errno == EMSGSIZE) {
+      log_library_socket_consume(sink, 1, 0);
+    } else {
+      if (!log_library_socket_would_block(errno)) {
+        log_library_socket_disconnect(sink);
       }
+      return;
     }
   }
-  va_end(argptr);
+#else
+  unsigned int i;
+  unsigned int sent = 0;
+
+  for (i = 0; i < sink->count; i++) {
+    if (send(sink->fd, sink->buffer + sink->offsets[i], sink->sizes[i], MSG_DONTWAIT | MSG_NOSIGNAL) >= 0) {
+      sent++;
+    } else if (errno != EMSGSIZE) {
+      if (!log_library_socket_would_block(errno)) {
+        log_library_socket_disconnect(sink);
+      }
+      break;
+    }
+  }
+  log_library_socket_consume(sink, i, sent);
+#endif
+}
+
+// Records are written back to back with one sendmsg, RFC5424 framing adds octet counting prefix
+static inline void log_library_socket_send_stream(log_library_socket_sink *sink) {
+  struct iovec iov[2 * LOG_LIBRARY_SOCKET_MAX_RECORDS];
+  char prefixes[LOG_LIBRARY_SOCKET_MAX_RECORDS][LOG_LIBRFARY_UINT_BUFFER_SIZE];
+  size_t prefix_sizes[LOG_LIBRARY_SOCKET_MAX_RECORDS];
+  struct msghdr message;
+  size_t skip;
+  size_t total;
+  ssize_t written;
+  unsigned int iov_count;
+  unsigned int i;
+
+  while (sink->count > 0) {
+    iov_count = 0;
+    skip = sink->head_skip;
+    for (i = 0; i < sink->count; i++) {
+      prefix_sizes[i] = 0;
+      if (sink->framing == LOG_LIBRARY_FRAMING_RFC5424) {
+        prefix_sizes[i] = (size_t) snprintf(prefixes[i], sizeof(prefixes[i]), "%lu ", (unsigned long) sink->sizes[i]);
+        if (skip < prefix_sizes[i]) {
+          iov[iov_count].iov_base = prefixes[i] + skip;
+          iov[iov_count].iov_len = prefix_sizes[i] - skip;
+          iov_count++;
+          skip = 0;
+        } else {
+          skip -= prefix_sizes[i];
+        }
+      }
+      iov[iov_count].iov_base = sink->buffer + sink->offsets[i] + skip;
+      iov[iov_count].iov_len = sink->sizes[i] - skip;
+      iov_count++;
+      skip = 0;
+    }
+
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = iov;
+    message.msg_iovlen = iov_count;
+    written = sendmsg(sink->fd, &message, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (written < 0) {
+      if (!log_library_socket_would_block(errno)) {
+        log_library_socket_disconnect(sink);
+      }
+      return;
+    }
+
+    // Partially sent record stays in the buffer with head_skip bytes already sent
+    for (i = 0; i < sink->count; i++) {
+      total = prefix_sizes[i] + sink->sizes[i] - sink->head_skip;
+      if ((size_t) written < total) {
+        sink->head_skip += (size_t) written;
+        break;
+      }
+      written -= (ssize_t) total;
+      sink->head_skip = 0;
+    }
+    log_library_socket_consume(sink, i, i);
+  }
+}
+
+static inline void log_library_socket_send(log_library_socket_sink *sink) {
+  if (!sink || sink->count == 0) {
+    return;
+  }
+  if (sink->fd < 0) {
+    if (log_library_monotonic_ms() < sink->retry_at || log_library_socket_connect(sink) != 0) {
+      return;
+    }
+  }
+  if (sink->type == LOG_LIBRARY_SOCKET_DGRAM) {
+    log_library_socket_send_dgram(sink);
+  } else {
+    log_library_socket_send_stream(sink);
+  }
+}
+
+// Starts new record, returns 0 if record is dropped because buffer is full
+static inline int log_library_socket_begin_record(log_library_socket_sink *sink, int severity) {
+  int written;
 
+  if (sink->count == LOG_LIBRARY_SOCKET_MAX_RECORDS || LOG_LIBRARY_SOCKET_BUFFER_SIZE - sink->used < LOG_LIBRARY_SOCKET_RECORD_SIZE) {
+    log_library_socket_send(sink);
+  }
+  if (sink->count == LOG_LIBRARY_SOCKET_MAX_RECORDS || LOG_LIBRARY_SOCKET_BUFFER_SIZE - sink->used < LOG_LIBRARY_SOCKET_RECORD_SIZE) {
+    sink->stats.dropped++;
+    return 0;
+  }
+
+  sink->record_start = sink->used;
+  sink->record_open = 1;
+  sink->record_severity = severity;
+  if (sink->framing == LOG_LIBRARY_FRAMING_RFC5424) {
+    // Facility is user-level messages (1)
+    written = snprintf(sink->buffer + sink->used, LOG_LIBRARY_SOCKET_BUFFER_SIZE - sink->used, "<%d>1 %s", 8 + severity, sink->header);
+    if (written > 0) {
+      sink->used += (size_t) written;
+    }
+  }
+  return 1;
+}
+
+static inline void log_library_socket_append(log_library_socket_sink *sink, const char *data, size_t size) {
+  size_t available = LOG_LIBRARY_SOCKET_BUFFER_SIZE - sink->used;
+
+  if (!sink->record_open) {
+    return;
+  }
+  if (size > available) {
+    size = available;
+  }
+  memcpy(sink->buffer + sink->used, data, size);
+  sink->used += size;
+}
+
+static inline void log_library_socket_vappend(log_library_socket_sink *sink, const char *fmt, va_list argptr) {
+  size_t available = LOG_LIBRARY_SOCKET_BUFFER_SIZE - sink->used;
+  int written;
+
+  if (!sink->record_open || available <= 1) {
+    return;
+  }
+  written = vsnprintf(sink->buffer + sink->used, available, fmt, argptr);
+  if (written > 0) {
+    sink->used += (size_t) written < available ? (size_t) written : available - 1;
+  }
+}
+
+static inline void log_library_socket_end_record(log_library_socket_sink *sink) {
+  int send_now;
+
+  if (!sink->record_open) {
+    return;
+  }
+  sink->record_open = 0;
+  // Syslog message has no trailing newline, the frame already delimits it
+  if (sink->framing == LOG_LIBRARY_FRAMING_RFC5424 && sink->used > sink->record_start && sink->buffer[sink->used - 1] == '\n') {
+    sink->used--;
+  }
+  sink->offsets[sink->count] = sink->record_start;
+  sink->sizes[sink->count] = sink->used - sink->record_start;
+  sink->count++;
+  if (sink->count == 1) {
+    sink->oldest_at = log_library_monotonic_ms();
+  }
+
+  // Batch is sent when it is full, on error or when the oldest record waits longer than max delay.
+  // Without LOG_LIBRARY_DISABLE_FLUSH record is sent at once if nothing else is pending,
+  // while agent is behind records are collected into batches.
+  send_now = sink->count >= sink->batch || sink->record_severity <= LOG_LIBRARY_SEVERITY_ERROR;
 #ifndef LOG_LIBRARY_DISABLE_FLUSH
-  fflush(output);
+  send_now = send_now || sink->count == 1;
 #endif
+  if (send_now || log_library_monotonic_ms() - sink->oldest_at >= sink->max_delay_ms) {
+    log_library_socket_send(sink);
+  }
+}
 
-  LOG_LIBRARY_UNLOCK();
+// Sends pending records waiting up to LOG_LIBRARY_SOCKET_CLOSE_TIMEOUT_MS, records left are counted as dropped
+static inline void log_library_socket_drain(log_library_socket_sink *sink) {
+  uint64_t deadline = log_library_monotonic_ms() + LOG_LIBRARY_SOCKET_CLOSE_TIMEOUT_MS;
+  uint64_t now;
+  struct pollfd poll_fd;
+
+  // Last chance to deliver, reconnect without waiting for backoff
+  sink->retry_at = 0;
+  log_library_socket_send(sink);
+  while (sink->count > 0 && sink->fd >= 0 && (now = log_library_monotonic_ms()) < deadline) {
+    poll_fd.fd = sink->fd;
+    poll_fd.events = POLLOUT;
+    poll_fd.revents = 0;
+    if (poll(&poll_fd, 1, (int) (deadline - now)) < 0 && errno != EINTR) {
+      break;
+    }
+    log_library_socket_send(sink);
+  }
+  sink->stats.dropped += sink->count;
+  sink->stats.pending = 0;
+  sink->count = 0;
 }
+#endif
 
-static inline void log_library_flush_log() {
-  LOG_LIBRARY_LOCK();
-  log_library_flush_log_unlocked();
-  LOG_LIBRARY_UNLOCK();
+// Sends log records to UNIX socket at path instead of the log file.
+// type is LOG_LIBRARY_SOCKET_STREAM or LOG_LIBRARY_SOCKET_DGRAM, framing is LOG_LIBRARY_FRAMING_NONE
+// (newline separated records) or LOG_LIBRARY_FRAMING_RFC5424. app_name is used by RFC5424 framing, can be NULL.
+// If socket is not available records are buffered and connection is retried with backoff.
+static inline void log_library_set_socket(const char *path, int type, int framing, const char *app_name) {
+  log_library_set_socket_l(&log_library_default_logger, path, type, framing, app_name);
 }
 
-static inline void log_library_flush_log_unlocked() {
-  FILE *output = log_library_log_file ? log_library_log_file : stderr;
-  fflush(output);
-  int is_terminal = output == stderr;
-  if (!is_terminal) {
-    log_library_log_size = ftell(output);
+static inline void log_library_set_socket_unlocked(const char *path, int type, int framing, const char *app_name) {
+  log_library_set_socket_unlocked_l(&log_library_default_logger, path, type, framing, app_name);
+}
+
+static inline void log_library_set_socket_l(log_library_logger *logger, const char *path, int type, int framing, const char *app_name) {
+  LOG_LIBRARY_LOCK_L(logger);
+  log_library_set_socket_unlocked_l(logger, path, type, framing, app_name);
+  LOG_LIBRARY_UNLOCK_L(logger);
+}
+
+static inline void log_library_set_socket_unlocked_l(log_library_logger *logger, const char *path, int type, int framing, const char *app_name) {
+#ifdef LOG_LIBRARY_SOCKET_SUPPORT
+  log_library_socket_sink *sink;
+  char host[64];
+
+  log_library_close_socket_unlocked_l(logger);
+  sink = (log_library_socket_sink *) calloc(1, sizeof(log_library_socket_sink));
+  if (!sink) {
+    return;
+  }
+  sink->fd = -1;
+  sink->type = type;
+  sink->framing = framing;
+  sink->batch = LOG_LIBRARY_SOCKET_DEFAULT_BATCH;
+  sink->max_delay_ms = LOG_LIBRARY_SOCKET_DEFAULT_MAX_DELAY_MS;
+  sink->backoff_ms = LOG_LIBRARY_SOCKET_MIN_BACKOFF_MS;
+  sink->address.sun_family = AF_UNIX;
+  snprintf(sink->address.sun_path, sizeof(sink->address.sun_path), "%s", path);
+  if (gethostname(host, sizeof(host)) != 0) {
+    snprintf(host, sizeof(host), "-");
   }
+  host[sizeof(host) - 1] = '\0';
+  // TIMESTAMP HOSTNAME APP-NAME PROCID MSGID STRUCTURED-DATA, time is already in the message
+  snprintf(sink->header, sizeof(sink->header), "- %s %s %d - - ",
+           host, app_name && app_name[0] ? app_name : "-", (int) getpid());
+  logger->socket = sink;
+  log_library_socket_connect(sink);
+#else
+  (void) logger;
+  (void) path;
+  (void) type;
+  (void) framing;
+  (void) app_name;
+#endif
 }
 
+// Number of records that are sent with one system call, used with LOG_LIBRARY_DISABLE_FLUSH
+static inline void log_library_set_socket_batch(unsigned int records) {
+  log_library_set_socket_batch_l(&log_library_default_logger, records);
+}
 
-#ifndef LOG_LIBRARY_TAG_SUPPORT
+static inline void log_library_set_socket_batch_unlocked(unsigned int records) {
+  log_library_set_socket_batch_unlocked_l(&log_library_default_logger, records);
+}
 
-#define ___LOG___(color, fmt, level, path, ...)                                                            \
-  do {                                                                                                     \
-    char log_library_time_buffer[LOG_LIBRFARY_TIME_BUFFER_SIZE];                                           \
-    log_library_format_current_time(log_library_time_buffer, LOG_LIBRFARY_TIME_BUFFER_SIZE);               \
-    log_library_log_message(color, "%s [%s] [%s:%d] [%s] " fmt "\n",                                       \
-                            log_library_time_buffer, level, path, LOG_LIBRARY_LINE, LOG_LIBRARY_FUNC_NAME, \
-                            ##__VA_ARGS__);                                                                \
-  } while (0)
+static inline void log_library_set_socket_batch_l(log_library_logger *logger, unsigned int records) {
+  LOG_LIBRARY_LOCK_L(logger);
+  log_library_set_socket_batch_unlocked_l(logger, records);
+  LOG_LIBRARY_UNLOCK_L(logger);
+}
 
-#ifdef LOG_LIBRARY_LOG_SIMPLE
-#undef ___LOG___
-#define ___LOG___(color, fmt, level, path, ...)                                                         \
-  do {                                                                                                  \
-    char log_library_time_buffer[LOG_LIBRFARY_TIME_BUFFER_SIZE];                                        \
-    log_library_format_current_time(log_library_time_buffer, LOG_LIBRFARY_TIME_BUFFER_SIZE);            \
-    log_library_log_message(color, "%s [%s] " fmt "\n", log_library_time_buffer, level, ##__VA_ARGS__); \
-  } while (0)
+static inline void log_library_set_socket_batch_unlocked_l(log_library_logger *logger, unsigned int records) {
+#ifdef LOG_LIBRARY_SOCKET_SUPPORT
+  if (logger->socket) {
+    if (records == 0) {
+      records = 1;
+    }
+    logger->socket->batch = records < LOG_LIBRARY_SOCKET_MAX_RECORDS ? records : LOG_LIBRARY_SOCKET_MAX_RECORDS;
+  }
+#else
+  (void) logger;
+  (void) records;
+#endif
+}
+
+// Longest time a buffered record waits for the rest of the batch, used with LOG_LIBRARY_DISABLE_FLUSH.
+// The delay is checked when the next record is written or on log_library_flush_log.
+static inline void log_library_set_socket_max_delay(unsigned int max_delay_ms) {
+  log_library_set_socket_max_delay_l(&log_library_default_logger, max_delay_ms);
+}
+
+static inline void log_library_set_socket_max_delay_unlocked(unsigned int max_delay_ms) {
+  log_library_set_socket_max_delay_unlocked_l(&log_library_default_logger, max_delay_ms);
+}
+
+static inline void log_library_set_socket_max_delay_l(log_library_logger *logger, unsigned int max_delay_ms) {
+  LOG_LIBRARY_LOCK_L(logger);
+  log_library_set_socket_max_delay_unlocked_l(logger, max_delay_ms);
+  LOG_LIBRARY_UNLOCK_L(logger);
+}
+
+static inline void log_library_set_socket_max_delay_unlocked_l(log_library_logger *logger, unsigned int max_delay_ms) {
+#ifdef LOG_LIBRARY_SOCKET_SUPPORT
+  if (logger->socket) {
+    logger->socket->max_delay_ms = max_delay_ms;
+  }
+#else
+  (void) logger;
+  (void) max_delay_ms;
 #endif
+}
+
+// Sends pending records waiting up to LOG_LIBRARY_SOCKET_CLOSE_TIMEOUT_MS and returns to file or stderr output.
+// Records that can't be sent are counted as dropped, stats of the closed socket stay available.
+static inline void log_library_close_socket() {
+  log_library_close_socket_l(&log_library_default_logger);
+}
+
+static inline void log_library_close_socket_unlocked() {
+  log_library_close_socket_unlocked_l(&log_library_default_logger);
+}
 
-#define LOGDEBUG(fmt, ...) ___LOG___(COLOR_BLUE, fmt, "DEBUG", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
-#define LOGINFO(fmt, ...) ___LOG___(COLOR_GREEN, fmt, "INFO", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
-#define LOGWARN(fmt, ...) ___LOG___(COLOR_YELLOW, fmt, "WARN", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
-#define LOGERROR(fmt, ...) ___LOG___(COLOR_RED, fmt, "ERROR", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
+static inline void log_library_close_socket_l(log_library_logger *logger) {
+  LOG_LIBRARY_LOCK_L(logger);
+  log_library_close_socket_unlocked_l(logger);
+  LOG_LIBRARY_UNLOCK_L(logger);
+}
 
+static inline void log_library_close_socket_unlocked_l(log_library_logger *logger) {
+#ifdef LOG_LIBRARY_SOCKET_SUPPORT
+  if (logger->socket) {
+    log_library_socket_drain(logger->socket);
+    if (logger->socket->fd >= 0) {
+      close(logger->socket->fd);
+    }
+    logger->socket_stats = logger->socket->stats;
+    free(logger->socket);
+    logger->socket = NULL;
+  }
 #else
+  (void) logger;
+#endif
+}
 
-#define ___LOG___(color, fmt, tag, level, path, ...)                                                            \
-  do {                                                                                                          \
-    char log_library_time_buffer[LOG_LIBRFARY_TIME_BUFFER_SIZE];                                                \
-    log_library_format_current_time(log_library_time_buffer, LOG_LIBRFARY_TIME_BUFFER_SIZE);                    \
-    log_library_log_message(color, "%s [%s] [%s] [%s:%d] [%s] " fmt "\n",                                       \
-                            log_library_time_buffer, tag, level, path, LOG_LIBRARY_LINE, LOG_LIBRARY_FUNC_NAME, \
-                            ##__VA_ARGS__);                                                                     \
-  } while (0)
+static inline void log_library_get_socket_stats(log_library_socket_stats *stats) {
+  log_library_get_socket_stats_l(&log_library_default_logger, stats);
+}
 
-#ifdef LOG_LIBRARY_LOG_SIMPLE
-#undef ___LOG___
-#define ___LOG___(color, fmt, tag, level, path, ...)                                                              \
-  do {                                                                                                            \
-    char log_library_time_buffer[LOG_LIBRFARY_TIME_BUFFER_SIZE];                                                  \
-    log_library_format_current_time(log_library_time_buffer, LOG_LIBRFARY_TIME_BUFFER_SIZE);                      \
-    log_library_log_message(color, "%s [%s] [%s] " fmt "\n", log_library_time_buffer, tag, level, ##__VA_ARGS__); \
-  } while (0)
+static inline void log_library_get_socket_stats_unlocked(log_library_socket_stats *stats) {
+  log_library_get_socket_stats_unlocked_l(&log_library_default_logger, stats);
+}
+
+static inline void log_library_get_socket_stats_l(log_library_logger *logger, log_library_socket_stats *stats) {
+  LOG_LIBRARY_LOCK_L(logger);
+  log_library_get_socket_stats_unlocked_l(logger, stats);
+  LOG_LIBRARY_UNLOCK_L(logger);
+}
+
+static inline void log_library_get_socket_stats_unlocked_l(log_library_logger *logger, log_library_socket_stats *stats) {
+  memset(stats, 0, sizeof(*stats));
+#ifdef LOG_LIBRARY_SOCKET_SUPPORT
+  if (logger->socket) {
+    *stats = logger->socket->stats;
+    stats->pending = logger->socket->count;
+  } else {
+    *stats = logger->socket_stats;
+  }
+#else
+  (void) logger;
 #endif
+}
 
-#define LOGDEBUG(tag, fmt, ...) ___LOG___(COLOR_BLUE, fmt, tag, "DEBUG", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
-#define LOGINFO(tag, fmt, ...) ___LOG___(COLOR_GREEN, fmt, tag, "INFO", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
-#define LOGWARN(tag, fmt, ...) ___LOG___(COLOR_YELLOW, fmt, tag, "WARN", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
-#define LOGERROR(tag, fmt, ...) ___LOG___(COLOR_RED, fmt, tag, "ERROR", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
+// Writes every thread to its own file "file_path.shard.generation", NULL disables sharding.
+// Sharded records are written without the global lock, use logger_merge to get one ordered log.
+static inline void log_library_set_sharded_log_file(const char *file_path) {
+  LOG_LIBRARY_LOCK();
+  log_library_set_sharded_log_file_unlocked(file_path);
+  LOG_LIBRARY_UNLOCK();
+}
 
+#if !defined(_WIN32) && !defined(_WIN64)
+static inline void log_library_shard_destructor(void *value) {
+  log_library_shard *shard = (log_library_shard *) value;
+  if (shard->file) {
+    fclose(shard->file);
+    shard->file = NULL;
+  }
+}
 #endif
 
-#if defined(LOG_LIBRARY_LOG_LEVEL_ERROR)
-#undef LOGDEBUG
-#undef LOGINFO
-#undef LOGWARN
-#define LOGDEBUG(fmt, ...) ((void) 0)
-#define LOGINFO(fmt, ...) ((void) 0)
-#define LOGWARN(fmt, ...) ((void) 0)
-#elif defined(LOG_LIBRARY_LOG_LEVEL_WARN)
-#undef LOGDEBUG
-#undef LOGINFO
-#define LOGDEBUG(fmt, ...) ((void) 0)
-#define LOGINFO(fmt, ...) ((void) 0)
-#elif defined(LOG_LIBRARY_LOG_LEVEL_DEBUG)
-#undef LOGINFO
-#define LOGINFO(fmt, ...) ((void) 0)
-#elif defined(LOG_LIBRARY_LOG_LEVEL_INFO)
+static inline void log_library_set_sharded_log_file_unlocked(const char *file_path) {
+#if !defined(_WIN32) && !defined(_WIN64)
+  if (!log_library_shard_key_created) {
+    pthread_key_create(&log_library_shard_key, log_library_shard_destructor);
+    log_library_shard_key_created = 1;
+  }
 #endif
+  if (file_path) {
+    snprintf(log_library_shard_path, sizeof(log_library_shard_path), "%s", file_path);
+  }
+  log_library_shard_counter = 0;
+  // Thread that sees the new epoch also sees the new path
+  LOG_LIBRARY_ATOMIC_STORE_RELEASE(&log_library_shard_epoch, log_library_shard_epoch + 1);
+  LOG_LIBRARY_ATOMIC_STORE_RELEASE(&log_library_shard_enabled, file_path != NULL);
+}
 
-#ifdef __cplusplus
-#include <sstream>
-#include <stdexcept>
-#include <string>
+// Callback is called from the thread that owns the shard after it moved to the next generation
+static inline void log_library_set_max_shard_size_callback(log_library_shard_callback callback, void *userdata) {
+  LOG_LIBRARY_LOCK();
+  log_library_set_max_shard_size_callback_unlocked(callback, userdata);
+  LOG_LIBRARY_UNLOCK();
+}
 
-static inline const void SSTR(char *buffer, int size, unsigned int x) {
-  snprintf(buffer, size, "%u", x);
+static inline void log_library_set_max_shard_size_callback_unlocked(log_library_shard_callback callback, void *userdata) {
+  log_library_max_shard_size_callback = callback;
+  log_library_shard_userdata = userdata;
 }
 
-static inline std::string log_library_form_exception(const char *short_file, unsigned int line, const char *LOG_LIBRARY_func_name, const char *fmt, ...) {
-  char log_library_time_buffer[LOG_LIBRFARY_TIME_BUFFER_SIZE];
-  log_library_format_current_time(log_library_time_buffer, LOG_LIBRFARY_TIME_BUFFER_SIZE);
-  std::string message = "[EXCEPTION]";
-  message += " ";
-  message += log_library_time_buffer;
-  message += " ";
-#ifndef LOG_LIBRARY_LOG_SIMPLE
-  message += "[";
-  message += short_file;
-  message += ":";
-  char log_library_uint_buffer[LOG_LIBRFARY_UINT_BUFFER_SIZE];
-  SSTR(log_library_uint_buffer, LOG_LIBRFARY_UINT_BUFFER_SIZE, line);
-  message += log_library_uint_buffer;
-  message += "]";
-  message += " ";
-  message += "[";
-  message += LOG_LIBRARY_func_name;
-  message += "]";
-  message += " ";
-#endif
-  message += fmt;
-  return message;
+static inline unsigned int log_library_get_shard_size() {
+  return log_library_thread_shard.size;
 }
 
-#define EXCEPTION(fmt, ...) (log_library_form_exception(LOG_LIBRARY_SHORT_FILE, LOG_LIBRARY_LINE, LOG_LIBRARY_FUNC_NAME, fmt, ##__VA_ARGS__))
+static inline void log_library_close_shard() {
+  log_library_shard *shard = &log_library_thread_shard;
+  if (shard->file) {
+    fclose(shard->file);
+    shard->file = NULL;
+    shard->size = 0;
+  }
+}
+
+static inline void log_library_shard_open(log_library_shard *shard) {
+  char path[LOG_LIBRARY_SHARD_PATH_SIZE + 2 * LOG_LIBRFARY_UINT_BUFFER_SIZE];
+
+  snprintf(path, sizeof(path), "%s.%u.%u", shard->base_path, shard->shard, shard->generation);
+  shard->file = fopen(path, "a");
+  shard->size = 0;
+  if (shard->file) {
+    fseek(shard->file, 0, SEEK_END);
+    shard->size = ftell(shard->file);
+  } else {
+    shard->retry_at = time(NULL) + LOG_LIBRARY_SHARD_RETRY_SECONDS;
+  }
+}
+
+static inline void log_library_shard_parse_name(const char *base_name, const char *name, log_library_shard_visitor visit, void *userdata) {
+  size_t base_size = strlen(base_name);
+  unsigned long shard;
+  unsigned long generation;
+  char *end;
+
+  if (strncmp(name, base_name, base_size) != 0 || name[base_size] != '.') {
+    return;
+  }
+  name += base_size + 1;
+  if (*name < '0' || *name > '9') {
+    return;
+  }
+  shard = strtoul(name, &end, 10);
+  if (*end != '.' || end[1] < '0' || end[1] > '9') {
+    return;
+  }
+  generation = strtoul(end + 1, &end, 10);
+  if (*end != '\0') {
+    return;
+  }
+  visit(userdata, (unsigned int) shard, (unsigned int) generation);
+}
+
+// Calls visit for every shard file "base_path.shard.generation" in the directory of base_path
+static inline void log_library_shard_scan(const char *base_path, log_library_shard_visitor visit, void *userdata) {
+  char directory[LOG_LIBRARY_SHARD_PATH_SIZE];
+  const char *base_name = strrchr(base_path, '/');
+#if defined(_WIN32) || defined(_WIN64)
+  char pattern[LOG_LIBRARY_SHARD_PATH_SIZE + 2];
+  WIN32_FIND_DATAA data;
+  HANDLE find;
+  const char *backslash = strrchr(base_path, '\\');
+  if (!base_name || (backslash && backslash > base_name)) {
+    base_name = backslash;
+  }
+#else
+  DIR *dir;
+  struct dirent *entry;
+#endif
+
+  if (base_name) {
+    snprintf(directory, sizeof(directory), "%.*s", (int) (base_name - base_path), base_path);
+    if (directory[0] == '\0') {
+      snprintf(directory, sizeof(directory), "/");
+    }
+    base_name++;
+  } else {
+    snprintf(directory, sizeof(directory), ".");
+    base_name = base_path;
+  }
+
+#if defined(_WIN32) || defined(_WIN64)
+  snprintf(pattern, sizeof(pattern), "%s\\*", directory);
+  find = FindFirstFileA(pattern, &data);
+  if (find == INVALID_HANDLE_VALUE) {
+    return;
+  }
+  do {
+    log_library_shard_parse_name(base_name, data.cFileName, visit, userdata);
+  } while (FindNextFileA(find, &data));
+  FindClose(find);
+#else
+  dir = opendir(directory);
+  if (!dir) {
+    return;
+  }
+  while ((entry = readdir(dir)) != NULL) {
+    log_library_shard_parse_name(base_name, entry->d_name, visit, userdata);
+  }
+  closedir(dir);
+#endif
+}
+
+// Moves generation of the calling thread's shard past every existing file of that shard
+static inline void log_library_shard_visit(void *userdata, unsigned int shard, unsigned int generation) {
+  log_library_shard *thread_shard = (log_library_shard *) userdata;
+  if (shard == thread_shard->shard && generation >= thread_shard->generation) {
+    thread_shard->generation = generation + 1;
+  }
+}
+
+// Returns shard file of the calling thread, stderr if it can't be opened.
+// Shard number is taken once per sharding epoch, failed open is retried after LOG_LIBRARY_SHARD_RETRY_SECONDS.
+static inline FILE *log_library_shard_begin() {
+  log_library_shard *shard = &log_library_thread_shard;
+
+  if (shard->epoch == (unsigned int) LOG_LIBRARY_ATOMIC_LOAD_ACQUIRE(&log_library_shard_epoch)) {
+    if (!shard->file && time(NULL) >= shard->retry_at) {
+      log_library_shard_open(shard);
+    }
+    return shard->file ? shard->file : stderr;
+  }
+
+  log_library_close_shard();
+  LOG_LIBRARY_LOCK();
+  shard->epoch = log_library_shard_epoch;
+  shard->shard = log_library_shard_counter++;
+  snprintf(shard->base_path, sizeof(shard->base_path), "%s", log_library_shard_path);
+  LOG_LIBRARY_UNLOCK();
+#if !defined(_WIN32) && !defined(_WIN64)
+  pthread_setspecific(log_library_shard_key, shard);
+#endif
+
+  // Shards of previous runs are kept, new records go after the newest generation even if older ones were removed
+  shard->generation = 0;
+  log_library_shard_scan(shard->base_path, log_library_shard_visit, shard);
+  log_library_shard_open(shard);
+  return shard->file ? shard->file : stderr;
+}
+
+static inline void log_library_shard_end(FILE *output) {
+  log_library_shard *shard = &log_library_thread_shard;
+  char path[LOG_LIBRARY_SHARD_PATH_SIZE + 2 * LOG_LIBRFARY_UINT_BUFFER_SIZE];
+  log_library_shard_callback callback;
+  void *userdata;
+  unsigned int max_size;
+
+#ifndef LOG_LIBRARY_DISABLE_FLUSH
+  fflush(output);
+#endif
+  if (output != shard->file) {
+    return;
+  }
+  shard->size = ftell(output);
+  max_size = LOG_LIBRARY_ATOMIC_LOAD(&log_library_default_logger.log_max_size);
+  if (max_size != 0 && shard->size >= max_size) {
+    snprintf(path, sizeof(path), "%s.%u.%u", shard->base_path, shard->shard, shard->generation);
+    log_library_close_shard();
+    shard->generation++;
+    log_library_shard_open(shard);
+
+    // Rotation is rare, callback and userdata are taken together under the lock
+    LOG_LIBRARY_LOCK();
+    callback = log_library_max_shard_size_callback;
+    userdata = log_library_shard_userdata;
+    LOG_LIBRARY_UNLOCK();
+    if (callback) {
+      callback(path, userdata);
+    }
+  }
+}
+
+// Function to print log message
+static inline void log_library_log_message(log_library_logger *logger, const char *color, int severity, const char *fmt, ...) {
+  va_list argptr;
+
+  if (logger == &log_library_default_logger && LOG_LIBRARY_ATOMIC_LOAD_ACQUIRE(&log_library_shard_enabled)) {
+    FILE *shard_output = log_library_shard_begin();
+    va_start(argptr, fmt);
+    vfprintf(shard_output, fmt, argptr);
+    va_end(argptr);
+    log_library_shard_end(shard_output);
+    return;
+  }
+
+  LOG_LIBRARY_LOCK_L(logger);
+  va_start(argptr, fmt);
+
+#ifdef LOG_LIBRARY_SOCKET_SUPPORT
+  if (logger->socket) {
+    if (log_library_socket_begin_record(logger->socket, severity)) {
+      log_library_socket_vappend(logger->socket, fmt, argptr);
+      log_library_socket_end_record(logger->socket);
+    }
+    va_end(argptr);
+    LOG_LIBRARY_UNLOCK_L(logger);
+    return;
+  }
+#else
+  (void) severity;
+#endif
+
+  FILE *output = logger->log_file ? logger->log_file : stderr;
+  int is_terminal = output == stderr;
+
+  if (is_terminal) {
+    fprintf(output, "%s", color);
+    vfprintf(output, fmt, argptr);
+    fprintf(output, "%s", COLOR_RESET);
+  } else {
+    vfprintf(output, fmt, argptr);
+    log_library_update_log_size_unlocked(logger, output);
+  }
+  va_end(argptr);
+
+#ifndef LOG_LIBRARY_DISABLE_FLUSH
+  fflush(output);
+#endif
+
+  LOG_LIBRARY_UNLOCK_L(logger);
+}
+
+static inline void log_library_update_log_size_unlocked(log_library_logger *logger, FILE *output) {
+  logger->log_size = ftell(output);
+  if (logger->log_max_size != 0 && logger->log_size >= logger->log_max_size) {
+    if (logger->max_file_size_callback) {
+      logger->max_file_size_callback(logger->userdata);
+    }
+  }
+}
+
+// Bytes shown by hex dump, limit 0 means no truncation
+static inline void log_library_set_hex_limit(unsigned int limit) {
+  log_library_set_hex_limit_l(&log_library_default_logger, limit);
+}
+
+static inline void log_library_set_hex_limit_unlocked(unsigned int limit) {
+  log_library_set_hex_limit_unlocked_l(&log_library_default_logger, limit);
+}
+
+static inline void log_library_set_hex_limit_l(log_library_logger *logger, unsigned int limit) {
+  LOG_LIBRARY_LOCK_L(logger);
+  log_library_set_hex_limit_unlocked_l(logger, limit);
+  LOG_LIBRARY_UNLOCK_L(logger);
+}
+
+static inline void log_library_set_hex_limit_unlocked_l(log_library_logger *logger, unsigned int limit) {
+  LOG_LIBRARY_ATOMIC_STORE(&logger->hex_limit, limit);
+}
+
+static inline void log_library_set_hex_mode(int mode) {
+  log_library_set_hex_mode_l(&log_library_default_logger, mode);
+}
+
+static inline void log_library_set_hex_mode_unlocked(int mode) {
+  log_library_set_hex_mode_unlocked_l(&log_library_default_logger, mode);
+}
+
+static inline void log_library_set_hex_mode_l(log_library_logger *logger, int mode) {
+  LOG_LIBRARY_LOCK_L(logger);
+  log_library_set_hex_mode_unlocked_l(logger, mode);
+  LOG_LIBRARY_UNLOCK_L(logger);
+}
+
+static inline void log_library_set_hex_mode_unlocked_l(log_library_logger *logger, int mode) {
+  LOG_LIBRARY_ATOMIC_STORE(&logger->hex_mode, mode);
+}
+
+// Writes 2 * size lowercase hex characters, without terminating zero
+static inline void log_library_hex_encode(char *dst, const unsigned char *src, size_t size) {
+  static const char digits[] = "0123456789abcdef";
+  size_t i = 0;
+
+#if defined(LOG_LIBRARY_HEX_SSE2)
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  const __m128i nine = _mm_set1_epi8(9);
+  const __m128i zero_char = _mm_set1_epi8('0');
+  const __m128i alpha_offset = _mm_set1_epi8('a' - '0' - 10);
+  for (; i + 16 <= size; i += 16) {
+    __m128i value = _mm_loadu_si128((const __m128i *) (src + i));
+    __m128i high = _mm_and_si128(_mm_srli_epi16(value, 4), mask);
+    __m128i low = _mm_and_si128(value, mask);
+    high = _mm_add_epi8(_mm_add_epi8(high, zero_char), _mm_and_si128(_mm_cmpgt_epi8(high, nine), alpha_offset));
+    low = _mm_add_epi8(_mm_add_epi8(low, zero_char), _mm_and_si128(_mm_cmpgt_epi8(low, nine), alpha_offset));
+    _mm_storeu_si128((__m128i *) (dst + 2 * i), _mm_unpacklo_epi8(high, low));
+    _mm_storeu_si128((__m128i *) (dst + 2 * i + 16), _mm_unpackhi_epi8(high, low));
+  }
+#elif defined(LOG_LIBRARY_HEX_NEON)
+  const uint8x16_t table = vld1q_u8((const uint8_t *) digits);
+  const uint8x16_t mask = vdupq_n_u8(0x0f);
+  for (; i + 16 <= size; i += 16) {
+    uint8x16_t value = vld1q_u8(src + i);
+    uint8x16x2_t hex;
+    hex.val[0] = vqtbl1q_u8(table, vshrq_n_u8(value, 4));
+    hex.val[1] = vqtbl1q_u8(table, vandq_u8(value, mask));
+    vst2q_u8((uint8_t *) (dst + 2 * i), hex);
+  }
+#endif
+
+  for (; i < size; i++) {
+    dst[2 * i] = digits[src[i] >> 4];
+    dst[2 * i + 1] = digits[src[i] & 0x0f];
+  }
+}
+
+// Renders one classic dump line for up to 16 bytes: offset, hex bytes and ASCII column
+static inline size_t log_library_hex_line(char *dst, size_t offset, const unsigned char *src, size_t size) {
+  static const char digits[] = "0123456789abcdef";
+  char hex[32];
+  size_t pos = 0;
+  size_t i;
+  int shift;
+
+  log_library_hex_encode(hex, src, size);
+  for (shift = 28; shift >= 0; shift -= 4) {
+    dst[pos++] = digits[(offset >> shift) & 0x0f];
+  }
+  dst[pos++] = ' ';
+  dst[pos++] = ' ';
+  for (i = 0; i < 16; i++) {
+    if (i < size) {
+      dst[pos++] = hex[2 * i];
+      dst[pos++] = hex[2 * i + 1];
+    } else {
+      dst[pos++] = ' ';
+      dst[pos++] = ' ';
+    }
+    dst[pos++] = ' ';
+    if (i == 7) {
+      dst[pos++] = ' ';
+    }
+  }
+  dst[pos++] = '|';
+  for (i = 0; i < size; i++) {
+    dst[pos++] = (src[i] >= 0x20 && src[i] < 0x7f) ? (char) src[i] : '.';
+  }
+  dst[pos++] = '|';
+  dst[pos++] = '\n';
+  return pos;
+}
+
+// Writes to the output file, NULL output means socket sink
+static inline void log_library_sink_write(log_library_logger *logger, FILE *output, const char *data, size_t size) {
+#ifdef LOG_LIBRARY_SOCKET_SUPPORT
+  if (!output) {
+    log_library_socket_append(logger->socket, data, size);
+    return;
+  }
+#else
+  (void) logger;
+#endif
+  fwrite(data, 1, size, output);
+}
+
+static inline void log_library_sink_vprintf(log_library_logger *logger, FILE *output, const char *fmt, va_list argptr) {
+#ifdef LOG_LIBRARY_SOCKET_SUPPORT
+  if (!output) {
+    log_library_socket_vappend(logger->socket, fmt, argptr);
+    return;
+  }
+#else
+  (void) logger;
+#endif
+  vfprintf(output, fmt, argptr);
+}
+
+static inline void log_library_sink_printf(log_library_logger *logger, FILE *output, const char *fmt, ...) {
+  va_list argptr;
+  va_start(argptr, fmt);
+  log_library_sink_vprintf(logger, output, fmt, argptr);
+  va_end(argptr);
+}
+
+// Function to print hex dump of data, fmt is the message header
+static inline void log_library_log_hex(log_library_logger *logger, const char *color, int severity, const void *data, size_t size, const char *fmt, ...) {
+  char buffer[LOG_LIBRARY_HEX_BUFFER_SIZE];
+  const unsigned char *bytes = (const unsigned char *) data;
+  size_t shown;
+  size_t used = 0;
+  size_t offset;
+  size_t chunk;
+  unsigned int limit;
+  FILE *output;
+  int is_terminal;
+  va_list argptr;
+  int sharded = logger == &log_library_default_logger && LOG_LIBRARY_ATOMIC_LOAD_ACQUIRE(&log_library_shard_enabled);
+
+  if (sharded) {
+    output = log_library_shard_begin();
+  } else {
+    LOG_LIBRARY_LOCK_L(logger);
+    output = logger->log_file ? logger->log_file : stderr;
+  }
+#ifdef LOG_LIBRARY_SOCKET_SUPPORT
+  if (!sharded && logger->socket) {
+    if (!log_library_socket_begin_record(logger->socket, severity)) {
+      LOG_LIBRARY_UNLOCK_L(logger);
+      return;
+    }
+    output = NULL;
+  }
+#else
+  (void) severity;
+#endif
+  is_terminal = !sharded && output == stderr;
+  // Sharded records are written without the lock
+  limit = LOG_LIBRARY_ATOMIC_LOAD(&logger->hex_limit);
+  shown = (limit != 0 && size > limit) ? limit : size;
+
+  if (is_terminal) {
+    fprintf(output, "%s", color);
+  }
+  va_start(argptr, fmt);
+  log_library_sink_vprintf(logger, output, fmt, argptr);
+  va_end(argptr);
+
+  if (!bytes) {
+    // NULL data is not truncation, print it explicitly
+    log_library_sink_printf(logger, output, "(null) (%lu bytes)\n", (unsigned long) size);
+  } else if (LOG_LIBRARY_ATOMIC_LOAD(&logger->hex_mode) == LOG_LIBRARY_HEX_COMPACT) {
+    for (offset = 0; offset < shown; offset += chunk) {
+      chunk = shown - offset < LOG_LIBRARY_HEX_BUFFER_SIZE / 2 ? shown - offset : LOG_LIBRARY_HEX_BUFFER_SIZE / 2;
+      log_library_hex_encode(buffer, bytes + offset, chunk);
+      log_library_sink_write(logger, output, buffer, 2 * chunk);
+    }
+    if (shown < size) {
+      log_library_sink_printf(logger, output, "... (%lu of %lu bytes)", (unsigned long) shown, (unsigned long) size);
+    }
+    log_library_sink_write(logger, output, "\n", 1);
+  } else {
+    log_library_sink_printf(logger, output, "%lu bytes\n", (unsigned long) size);
+    for (offset = 0; offset < shown; offset += chunk) {
+      chunk = shown - offset < 16 ? shown - offset : 16;
+      if (used + LOG_LIBRARY_HEX_LINE_SIZE > LOG_LIBRARY_HEX_BUFFER_SIZE) {
+        log_library_sink_write(logger, output, buffer, used);
+        used = 0;
+      }
+      used += log_library_hex_line(buffer + used, offset, bytes + offset, chunk);
+    }
+    log_library_sink_write(logger, output, buffer, used);
+    if (shown < size) {
+      log_library_sink_printf(logger, output, "... %lu bytes truncated\n", (unsigned long) (size - shown));
+    }
+  }
+
+  if (sharded) {
+    log_library_shard_end(output);
+    return;
+  }
+
+#ifdef LOG_LIBRARY_SOCKET_SUPPORT
+  if (!output) {
+    log_library_socket_end_record(logger->socket);
+    LOG_LIBRARY_UNLOCK_L(logger);
+    return;
+  }
+#endif
+
+  if (is_terminal) {
+    fprintf(output, "%s", COLOR_RESET);
+  } else {
+    log_library_update_log_size_unlocked(logger, output);
+  }
+
+#ifndef LOG_LIBRARY_DISABLE_FLUSH
+  fflush(output);
+#endif
+
+  LOG_LIBRARY_UNLOCK_L(logger);
+}
+
+static inline void log_library_flush_log() {
+  log_library_flush_log_l(&log_library_default_logger);
+}
+
+static inline void log_library_flush_log_unlocked() {
+  if (log_library_thread_shard.file) {
+    fflush(log_library_thread_shard.file);
+  }
+  log_library_flush_log_unlocked_l(&log_library_default_logger);
+}
+
+static inline void log_library_flush_log_l(log_library_logger *logger) {
+  LOG_LIBRARY_LOCK_L(logger);
+  if (logger == &log_library_default_logger) {
+    log_library_flush_log_unlocked();
+  } else {
+    log_library_flush_log_unlocked_l(logger);
+  }
+  LOG_LIBRARY_UNLOCK_L(logger);
+}
+
+static inline void log_library_flush_log_unlocked_l(log_library_logger *logger) {
+#ifdef LOG_LIBRARY_SOCKET_SUPPORT
+  if (logger->socket) {
+    log_library_socket_send(logger->socket);
+    return;
+  }
+#endif
+  FILE *output = logger->log_file ? logger->log_file : stderr;
+  fflush(output);
+  int is_terminal = output == stderr;
+  if (!is_terminal) {
+    logger->log_size = ftell(output);
+  }
+}
+
+// Reader of one shard, generations are read one after another
+typedef struct {
+  unsigned int shard;
+  unsigned int *generations;
+  unsigned int generation_count;
+  unsigned int generation_index;
+  FILE *file;
+  char *line;
+  size_t line_size;
+  size_t line_capacity;
+  int has_line;
+  char *record;
+  size_t record_size;
+  size_t record_capacity;
+} log_library_merge_reader;
+
+struct log_library_merge {
+  char base_path[LOG_LIBRARY_SHARD_PATH_SIZE];
+  log_library_merge_reader *readers;
+  unsigned int reader_count;
+  unsigned int *heap;
+  unsigned int heap_size;
+  int current;
+};
+
+static inline int log_library_merge_reserve(char **buffer, size_t *capacity, size_t size) {
+  char *resized;
+  size_t new_capacity = *capacity ? *capacity : LOG_LIBRARY_MERGE_LINE_SIZE;
+
+  if (size <= *capacity) {
+    return 1;
+  }
+  while (new_capacity < size) {
+    new_capacity *= 2;
+  }
+  resized = (char *) realloc(*buffer, new_capacity);
+  if (!resized) {
+    return 0;
+  }
+  *buffer = resized;
+  *capacity = new_capacity;
+  return 1;
+}
+
+// Reads next line of the shard with newline, moves to the next generation at the end of file.
+// Truncated last line of a generation (crashed process) is completed with newline.
+static inline int log_library_merge_read_line(log_library_merge *merge, log_library_merge_reader *reader) {
+  char path[LOG_LIBRARY_SHARD_PATH_SIZE + 2 * LOG_LIBRFARY_UINT_BUFFER_SIZE];
+
+  reader->line_size = 0;
+  for (;;) {
+    if (!reader->file) {
+      if (reader->generation_index >= reader->generation_count) {
+        return 0;
+      }
+      snprintf(path, sizeof(path), "%s.%u.%u", merge->base_path, reader->shard, reader->generations[reader->generation_index++]);
+      reader->file = fopen(path, "r");
+      continue;
+    }
+    if (!log_library_merge_reserve(&reader->line, &reader->line_capacity, reader->line_size + LOG_LIBRARY_MERGE_LINE_SIZE)) {
+      return 0;
+    }
+    if (!fgets(reader->line + reader->line_size, (int) (reader->line_capacity - reader->line_size), reader->file)) {
+      fclose(reader->file);
+      reader->file = NULL;
+      if (reader->line_size > 0) {
+        reader->line[reader->line_size++] = '\n';
+        reader->line[reader->line_size] = '\0';
+        return 1;
+      }
+      continue;
+    }
+    reader->line_size += strlen(reader->line + reader->line_size);
+    if (reader->line_size > 0 && reader->line[reader->line_size - 1] == '\n') {
+      return 1;
+    }
+  }
+}
+
+// Record starts with time, lines without it (hex dump, backtrace) belong to the previous record
+static inline int log_library_merge_is_record_start(const char *line, size_t size) {
+  return size >= LOG_LIBRARY_TIME_LENGTH && line[4] == '-' && line[7] == '-' && line[10] == ' ' &&
+         line[13] == ':' && line[16] == ':' && line[19] == '.' && line[0] >= '0' && line[0] <= '9';
+}
+
+static inline int log_library_merge_read_record(log_library_merge *merge, log_library_merge_reader *reader) {
+  reader->record_size = 0;
+  if (!reader->has_line && !log_library_merge_read_line(merge, reader)) {
+    return 0;
+  }
+  do {
+    if (!log_library_merge_reserve(&reader->record, &reader->record_capacity, reader->record_size + reader->line_size + 1)) {
+      return 0;
+    }
+    memcpy(reader->record + reader->record_size, reader->line, reader->line_size);
+    reader->record_size += reader->line_size;
+    reader->record[reader->record_size] = '\0';
+    reader->has_line = log_library_merge_read_line(merge, reader);
+  } while (reader->has_line && !log_library_merge_is_record_start(reader->line, reader->line_size));
+  return 1;
+}
+
+static inline int log_library_merge_less(log_library_merge *merge, unsigned int a, unsigned int b) {
+  log_library_merge_reader *first = &merge->readers[a];
+  log_library_merge_reader *second = &merge->readers[b];
+  size_t size = first->record_size < second->record_size ? first->record_size : second->record_size;
+  int result = strncmp(first->record, second->record, size < LOG_LIBRARY_TIME_LENGTH ? size : LOG_LIBRARY_TIME_LENGTH);
+  return result < 0 || (result == 0 && first->shard < second->shard);
+}
+
+static inline void log_library_merge_sift_down(log_library_merge *merge, unsigned int index) {
+  unsigned int smallest;
+  unsigned int child;
+  unsigned int swap;
+
+  for (;;) {
+    smallest = index;
+    child = 2 * index + 1;
+    if (child < merge->heap_size && log_library_merge_less(merge, merge->heap[child], merge->heap[smallest])) {
+      smallest = child;
+    }
+    child++;
+    if (child < merge->heap_size && log_library_merge_less(merge, merge->heap[child], merge->heap[smallest])) {
+      smallest = child;
+    }
+    if (smallest == index) {
+      return;
+    }
+    swap = merge->heap[index];
+    merge->heap[index] = merge->heap[smallest];
+    merge->heap[smallest] = swap;
+    index = smallest;
+  }
+}
+
+// Adds generation file to the reader of its shard
+static inline int log_library_merge_add_file(log_library_merge *merge, unsigned int shard, unsigned int generation) {
+  log_library_merge_reader *reader = NULL;
+  unsigned int *generations;
+  unsigned int i;
+
+  for (i = 0; i < merge->reader_count; i++) {
+    if (merge->readers[i].shard == shard) {
+      reader = &merge->readers[i];
+      break;
+    }
+  }
+  if (!reader) {
+    if (merge->reader_count == LOG_LIBRARY_MERGE_MAX_SHARDS) {
+      return 0;
+    }
+    reader = &merge->readers[merge->reader_count++];
+    reader->shard = shard;
+  }
+  generations = (unsigned int *) realloc(reader->generations, (reader->generation_count + 1) * sizeof(unsigned int));
+  if (!generations) {
+    return 0;
+  }
+  reader->generations = generations;
+  // Keep generations sorted
+  for (i = reader->generation_count; i > 0 && generations[i - 1] > generation; i--) {
+    generations[i] = generations[i - 1];
+  }
+  generations[i] = generation;
+  reader->generation_count++;
+  return 1;
+}
+
+static inline void log_library_merge_visit(void *userdata, unsigned int shard, unsigned int generation) {
+  log_library_merge_add_file((log_library_merge *) userdata, shard, generation);
+}
+
+// Opens all shards of file_path, returns NULL on allocation failure
+static inline log_library_merge *log_library_merge_open(const char *file_path) {
+  log_library_merge *merge = (log_library_merge *) calloc(1, sizeof(log_library_merge));
+  unsigned int i;
+
+  if (!merge) {
+    return NULL;
+  }
+  merge->readers = (log_library_merge_reader *) calloc(LOG_LIBRARY_MERGE_MAX_SHARDS, sizeof(log_library_merge_reader));
+  merge->heap = (unsigned int *) calloc(LOG_LIBRARY_MERGE_MAX_SHARDS, sizeof(unsigned int));
+  if (!merge->readers || !merge->heap) {
+    log_library_merge_close(merge);
+    return NULL;
+  }
+  snprintf(merge->base_path, sizeof(merge->base_path), "%s", file_path);
+  merge->current = -1;
+  log_library_shard_scan(merge->base_path, log_library_merge_visit, merge);
+
+  for (i = 0; i < merge->reader_count; i++) {
+    if (log_library_merge_read_record(merge, &merge->readers[i])) {
+      merge->heap[merge->heap_size++] = i;
+    }
+  }
+  for (i = merge->heap_size / 2; i > 0; i--) {
+    log_library_merge_sift_down(merge, i - 1);
+  }
+  return merge;
+}
+
+// Returns next record (one or more lines) or NULL at the end, record is valid until the next call
+static inline const char *log_library_merge_next(log_library_merge *merge, size_t *size) {
+  log_library_merge_reader *reader;
+
+  if (merge->current >= 0) {
+    if (!log_library_merge_read_record(merge, &merge->readers[merge->current])) {
+      merge->heap[0] = merge->heap[--merge->heap_size];
+    }
+    log_library_merge_sift_down(merge, 0);
+    merge->current = -1;
+  }
+  if (merge->heap_size == 0) {
+    return NULL;
+  }
+  merge->current = (int) merge->heap[0];
+  reader = &merge->readers[merge->current];
+  if (size) {
+    *size = reader->record_size;
+  }
+  return reader->record;
+}
+
+static inline void log_library_merge_close(log_library_merge *merge) {
+  unsigned int i;
+
+  if (!merge) {
+    return;
+  }
+  if (merge->readers) {
+    for (i = 0; i < merge->reader_count; i++) {
+      if (merge->readers[i].file) {
+        fclose(merge->readers[i].file);
+      }
+      free(merge->readers[i].generations);
+      free(merge->readers[i].line);
+      free(merge->readers[i].record);
+    }
+  }
+  free(merge->readers);
+  free(merge->heap);
+  free(merge);
+}
+
+static inline void log_library_context_render() {
+  log_library_context *context = &log_library_thread_context;
+  unsigned int count = context->depth < LOG_LIBRARY_CONTEXT_MAX_ENTRIES ? context->depth : LOG_LIBRARY_CONTEXT_MAX_ENTRIES;
+  size_t offset = 0;
+  unsigned int i;
+  int written;
+
+  context->prefix[0] = '\0';
+  if (context->thread_name[0]) {
+    written = snprintf(context->prefix, sizeof(context->prefix), "[%s] ", context->thread_name);
+    offset = written > 0 ? (size_t) written : 0;
+  }
+  for (i = 0; i < count && offset < sizeof(context->prefix); i++) {
+    written = snprintf(context->prefix + offset, sizeof(context->prefix) - offset, "[%s=%s] ",
+                       context->keys[i], context->values[i]);
+    if (written < 0) {
+      break;
+    }
+    offset += (size_t) written;
+  }
+}
+
+// Returns the rendered context prefix, empty string when no context is set
+static inline const char *log_library_context_prefix() {
+  return log_library_thread_context.prefix;
+}
+
+// Sets the name of the calling thread, empty or NULL name removes it
+static inline void log_library_context_set_thread_name(const char *name) {
+  log_library_context *context = &log_library_thread_context;
+  snprintf(context->thread_name, sizeof(context->thread_name), "%s", name ? name : "");
+  log_library_context_render();
+}
+
+// Pushes key=value pair on the context of the calling thread. Value is printf formatted.
+// Pairs over LOG_LIBRARY_CONTEXT_MAX_ENTRIES are not rendered but still must be popped.
+static inline void log_library_context_push(const char *key, const char *fmt, ...) {
+  va_list argptr;
+  va_start(argptr, fmt);
+  log_library_context_vpush(key, fmt, argptr);
+  va_end(argptr);
+}
+
+static inline void log_library_context_vpush(const char *key, const char *fmt, va_list argptr) {
+  log_library_context *context = &log_library_thread_context;
+  unsigned int index = context->depth++;
+
+  if (index >= LOG_LIBRARY_CONTEXT_MAX_ENTRIES) {
+    return;
+  }
+  snprintf(context->keys[index], sizeof(context->keys[index]), "%s", key);
+  vsnprintf(context->values[index], sizeof(context->values[index]), fmt, argptr);
+  log_library_context_render();
+}
+
+static inline void log_library_context_pop() {
+  log_library_context *context = &log_library_thread_context;
+  if (context->depth == 0) {
+    return;
+  }
+  context->depth--;
+  if (context->depth < LOG_LIBRARY_CONTEXT_MAX_ENTRIES) {
+    log_library_context_render();
+  }
+}
+
+// Removes all pairs and the thread name
+static inline void log_library_context_clear() {
+  log_library_context *context = &log_library_thread_context;
+  context->depth = 0;
+  context->thread_name[0] = '\0';
+  context->prefix[0] = '\0';
+}
+
+// Accessors for structured output, only rendered pairs are visible
+static inline unsigned int log_library_context_size() {
+  unsigned int depth = log_library_thread_context.depth;
+  return depth < LOG_LIBRARY_CONTEXT_MAX_ENTRIES ? depth : LOG_LIBRARY_CONTEXT_MAX_ENTRIES;
+}
+
+static inline const char *log_library_context_key(unsigned int index) {
+  return index < log_library_context_size() ? log_library_thread_context.keys[index] : NULL;
+}
+
+static inline const char *log_library_context_value(unsigned int index) {
+  return index < log_library_context_size() ? log_library_thread_context.values[index] : NULL;
+}
+
+static inline const char *log_library_context_thread_name() {
+  return log_library_thread_context.thread_name;
+}
+
+
+#ifndef LOG_LIBRARY_TAG_SUPPORT
+
+#define ___LOG___(logger, color, severity, fmt, level, path, ...)                                              \
+  do {                                                                                                         \
+    log_library_logger *log_library_logger_ptr = (logger);                                                     \
+    if (log_library_logger_level(log_library_logger_ptr) >= (severity)) {                                      \
+      char log_library_time_buffer[LOG_LIBRFARY_TIME_BUFFER_SIZE];                                             \
+      log_library_format_current_time(log_library_time_buffer, LOG_LIBRFARY_TIME_BUFFER_SIZE);                 \
+      if (log_library_context_prefix()[0] == '\0') {                                                           \
+        log_library_log_message(log_library_logger_ptr, color, severity, "%s [%s] [%s:%d] [%s] " fmt "\n",     \
+                                log_library_time_buffer, level, path, LOG_LIBRARY_LINE, LOG_LIBRARY_FUNC_NAME, \
+                                ##__VA_ARGS__);                                                                \
+      } else {                                                                                                 \
+        log_library_log_message(log_library_logger_ptr, color, severity, "%s [%s] [%s:%d] [%s] %s" fmt "\n",   \
+                                log_library_time_buffer, level, path, LOG_LIBRARY_LINE, LOG_LIBRARY_FUNC_NAME, \
+                                log_library_context_prefix(), ##__VA_ARGS__);                                  \
+      }                                                                                                        \
+    }                                                                                                          \
+  } while (0)
+
+#ifdef LOG_LIBRARY_LOG_SIMPLE
+#undef ___LOG___
+#define ___LOG___(logger, color, severity, fmt, level, path, ...)                                             \
+  do {                                                                                                        \
+    log_library_logger *log_library_logger_ptr = (logger);                                                    \
+    if (log_library_logger_level(log_library_logger_ptr) >= (severity)) {                                     \
+      char log_library_time_buffer[LOG_LIBRFARY_TIME_BUFFER_SIZE];                                            \
+      log_library_format_current_time(log_library_time_buffer, LOG_LIBRFARY_TIME_BUFFER_SIZE);                \
+      if (log_library_context_prefix()[0] == '\0') {                                                          \
+        log_library_log_message(log_library_logger_ptr, color, severity, "%s [%s] " fmt "\n",                 \
+                                log_library_time_buffer, level, ##__VA_ARGS__);                               \
+      } else {                                                                                                \
+        log_library_log_message(log_library_logger_ptr, color, severity, "%s [%s] %s" fmt "\n",               \
+                                log_library_time_buffer, level, log_library_context_prefix(), ##__VA_ARGS__); \
+      }                                                                                                       \
+    }                                                                                                         \
+  } while (0)
+#endif
+
+#define ___LOG_HEX___(logger, color, severity, level, path, ptr, len)                                       \
+  do {                                                                                                      \
+    log_library_logger *log_library_logger_ptr = (logger);                                                  \
+    if (log_library_logger_level(log_library_logger_ptr) >= (severity)) {                                   \
+      char log_library_time_buffer[LOG_LIBRFARY_TIME_BUFFER_SIZE];                                          \
+      log_library_format_current_time(log_library_time_buffer, LOG_LIBRFARY_TIME_BUFFER_SIZE);              \
+      if (log_library_context_prefix()[0] == '\0') {                                                        \
+        log_library_log_hex(log_library_logger_ptr, color, severity, ptr, len, "%s [%s] [%s:%d] [%s] ",     \
+                            log_library_time_buffer, level, path, LOG_LIBRARY_LINE, LOG_LIBRARY_FUNC_NAME); \
+      } else {                                                                                              \
+        log_library_log_hex(log_library_logger_ptr, color, severity, ptr, len, "%s [%s] [%s:%d] [%s] %s",   \
+                            log_library_time_buffer, level, path, LOG_LIBRARY_LINE, LOG_LIBRARY_FUNC_NAME,  \
+                            log_library_context_prefix());                                                  \
+      }                                                                                                     \
+    }                                                                                                       \
+  } while (0)
+
+#ifdef LOG_LIBRARY_LOG_SIMPLE
+#undef ___LOG_HEX___
+#define ___LOG_HEX___(logger, color, severity, level, path, ptr, len)                          \
+  do {                                                                                         \
+    log_library_logger *log_library_logger_ptr = (logger);                                     \
+    if (log_library_logger_level(log_library_logger_ptr) >= (severity)) {                      \
+      char log_library_time_buffer[LOG_LIBRFARY_TIME_BUFFER_SIZE];                             \
+      log_library_format_current_time(log_library_time_buffer, LOG_LIBRFARY_TIME_BUFFER_SIZE); \
+      if (log_library_context_prefix()[0] == '\0') {                                           \
+        log_library_log_hex(log_library_logger_ptr, color, severity, ptr, len, "%s [%s] ",     \
+                            log_library_time_buffer, level);                                   \
+      } else {                                                                                 \
+        log_library_log_hex(log_library_logger_ptr, color, severity, ptr, len, "%s [%s] %s",   \
+                            log_library_time_buffer, level, log_library_context_prefix());     \
+      }                                                                                        \
+    }                                                                                          \
+  } while (0)
+#endif
+
+#define LOGDEBUG(fmt, ...) ___LOG___(&log_library_default_logger, COLOR_BLUE, LOG_LIBRARY_SEVERITY_DEBUG, fmt, "DEBUG", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
+#define LOGINFO(fmt, ...) ___LOG___(&log_library_default_logger, COLOR_GREEN, LOG_LIBRARY_SEVERITY_INFO, fmt, "INFO", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
+#define LOGWARN(fmt, ...) ___LOG___(&log_library_default_logger, COLOR_YELLOW, LOG_LIBRARY_SEVERITY_WARN, fmt, "WARN", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
+#define LOGERROR(fmt, ...) ___LOG___(&log_library_default_logger, COLOR_RED, LOG_LIBRARY_SEVERITY_ERROR, fmt, "ERROR", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
+
+#define LOGDEBUG_L(logger, fmt, ...) ___LOG___(logger, COLOR_BLUE, LOG_LIBRARY_SEVERITY_DEBUG, fmt, "DEBUG", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
+#define LOGINFO_L(logger, fmt, ...) ___LOG___(logger, COLOR_GREEN, LOG_LIBRARY_SEVERITY_INFO, fmt, "INFO", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
+#define LOGWARN_L(logger, fmt, ...) ___LOG___(logger, COLOR_YELLOW, LOG_LIBRARY_SEVERITY_WARN, fmt, "WARN", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
+#define LOGERROR_L(logger, fmt, ...) ___LOG___(logger, COLOR_RED, LOG_LIBRARY_SEVERITY_ERROR, fmt, "ERROR", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
+
+#define LOGDEBUG_HEX(ptr, len) ___LOG_HEX___(&log_library_default_logger, COLOR_BLUE, LOG_LIBRARY_SEVERITY_DEBUG, "DEBUG", LOG_LIBRARY_SHORT_FILE, ptr, len)
+#define LOGINFO_HEX(ptr, len) ___LOG_HEX___(&log_library_default_logger, COLOR_GREEN, LOG_LIBRARY_SEVERITY_INFO, "INFO", LOG_LIBRARY_SHORT_FILE, ptr, len)
+#define LOGWARN_HEX(ptr, len) ___LOG_HEX___(&log_library_default_logger, COLOR_YELLOW, LOG_LIBRARY_SEVERITY_WARN, "WARN", LOG_LIBRARY_SHORT_FILE, ptr, len)
+#define LOGERROR_HEX(ptr, len) ___LOG_HEX___(&log_library_default_logger, COLOR_RED, LOG_LIBRARY_SEVERITY_ERROR, "ERROR", LOG_LIBRARY_SHORT_FILE, ptr, len)
+
+#define LOGDEBUG_HEX_L(logger, ptr, len) ___LOG_HEX___(logger, COLOR_BLUE, LOG_LIBRARY_SEVERITY_DEBUG, "DEBUG", LOG_LIBRARY_SHORT_FILE, ptr, len)
+#define LOGINFO_HEX_L(logger, ptr, len) ___LOG_HEX___(logger, COLOR_GREEN, LOG_LIBRARY_SEVERITY_INFO, "INFO", LOG_LIBRARY_SHORT_FILE, ptr, len)
+#define LOGWARN_HEX_L(logger, ptr, len) ___LOG_HEX___(logger, COLOR_YELLOW, LOG_LIBRARY_SEVERITY_WARN, "WARN", LOG_LIBRARY_SHORT_FILE, ptr, len)
+#define LOGERROR_HEX_L(logger, ptr, len) ___LOG_HEX___(logger, COLOR_RED, LOG_LIBRARY_SEVERITY_ERROR, "ERROR", LOG_LIBRARY_SHORT_FILE, ptr, len)
+
+#else
+
+#define ___LOG___(logger, color, severity, fmt, tag, level, path, ...)                                          \
+  do {                                                                                                          \
+    log_library_logger *log_library_logger_ptr = (logger);                                                      \
+    if (log_library_logger_level(log_library_logger_ptr) >= (severity)) {                                       \
+      char log_library_time_buffer[LOG_LIBRFARY_TIME_BUFFER_SIZE];                                              \
+      log_library_format_current_time(log_library_time_buffer, LOG_LIBRFARY_TIME_BUFFER_SIZE);                  \
+      if (log_library_context_prefix()[0] == '\0') {                                                            \
+        log_library_log_message(log_library_logger_ptr, color, severity, "%s [%s] [%s] [%s:%d] [%s] " fmt "\n", \
+                                log_library_time_buffer, tag, level, path, LOG_LIBRARY_LINE,                    \
+                                LOG_LIBRARY_FUNC_NAME, ##__VA_ARGS__);                                          \
+      } else {                                                                                                  \
+        log_library_log_message(log_library_logger_ptr, color, severity,                                        \
+                                "%s [%s] [%s] [%s:%d] [%s] %s" fmt "\n", log_library_time_buffer, tag, level,   \
+                                path, LOG_LIBRARY_LINE, LOG_LIBRARY_FUNC_NAME, log_library_context_prefix(),    \
+                                ##__VA_ARGS__);                                                                 \
+      }                                                                                                         \
+    }                                                                                                           \
+  } while (0)
+
+#ifdef LOG_LIBRARY_LOG_SIMPLE
+#undef ___LOG___
+#define ___LOG___(logger, color, severity, fmt, tag, level, path, ...)                               \
+  do {                                                                                               \
+    log_library_logger *log_library_logger_ptr = (logger);                                           \
+    if (log_library_logger_level(log_library_logger_ptr) >= (severity)) {                            \
+      char log_library_time_buffer[LOG_LIBRFARY_TIME_BUFFER_SIZE];                                   \
+      log_library_format_current_time(log_library_time_buffer, LOG_LIBRFARY_TIME_BUFFER_SIZE);       \
+      if (log_library_context_prefix()[0] == '\0') {                                                 \
+        log_library_log_message(log_library_logger_ptr, color, severity, "%s [%s] [%s] " fmt "\n",   \
+                                log_library_time_buffer, tag, level, ##__VA_ARGS__);                 \
+      } else {                                                                                       \
+        log_library_log_message(log_library_logger_ptr, color, severity, "%s [%s] [%s] %s" fmt "\n", \
+                                log_library_time_buffer, tag, level, log_library_context_prefix(),   \
+                                ##__VA_ARGS__);                                                      \
+      }                                                                                              \
+    }                                                                                                \
+  } while (0)
+#endif
+
+#define ___LOG_HEX___(logger, color, severity, tag, level, path, ptr, len)                                       \
+  do {                                                                                                           \
+    log_library_logger *log_library_logger_ptr = (logger);                                                       \
+    if (log_library_logger_level(log_library_logger_ptr) >= (severity)) {                                        \
+      char log_library_time_buffer[LOG_LIBRFARY_TIME_BUFFER_SIZE];                                               \
+      log_library_format_current_time(log_library_time_buffer, LOG_LIBRFARY_TIME_BUFFER_SIZE);                   \
+      if (log_library_context_prefix()[0] == '\0') {                                                             \
+        log_library_log_hex(log_library_logger_ptr, color, severity, ptr, len, "%s [%s] [%s] [%s:%d] [%s] ",     \
+                            log_library_time_buffer, tag, level, path, LOG_LIBRARY_LINE, LOG_LIBRARY_FUNC_NAME); \
+      } else {                                                                                                   \
+        log_library_log_hex(log_library_logger_ptr, color, severity, ptr, len, "%s [%s] [%s] [%s:%d] [%s] %s",   \
+                            log_library_time_buffer, tag, level, path, LOG_LIBRARY_LINE, LOG_LIBRARY_FUNC_NAME,  \
+                            log_library_context_prefix());                                                       \
+      }                                                                                                          \
+    }                                                                                                            \
+  } while (0)
+
+#ifdef LOG_LIBRARY_LOG_SIMPLE
+#undef ___LOG_HEX___
+#define ___LOG_HEX___(logger, color, severity, tag, level, path, ptr, len)                        \
+  do {                                                                                            \
+    log_library_logger *log_library_logger_ptr = (logger);                                        \
+    if (log_library_logger_level(log_library_logger_ptr) >= (severity)) {                         \
+      char log_library_time_buffer[LOG_LIBRFARY_TIME_BUFFER_SIZE];                                \
+      log_library_format_current_time(log_library_time_buffer, LOG_LIBRFARY_TIME_BUFFER_SIZE);    \
+      if (log_library_context_prefix()[0] == '\0') {                                              \
+        log_library_log_hex(log_library_logger_ptr, color, severity, ptr, len, "%s [%s] [%s] ",   \
+                            log_library_time_buffer, tag, level);                                 \
+      } else {                                                                                    \
+        log_library_log_hex(log_library_logger_ptr, color, severity, ptr, len, "%s [%s] [%s] %s", \
+                            log_library_time_buffer, tag, level, log_library_context_prefix());   \
+      }                                                                                           \
+    }                                                                                             \
+  } while (0)
+#endif
+
+#define LOGDEBUG(tag, fmt, ...) ___LOG___(&log_library_default_logger, COLOR_BLUE, LOG_LIBRARY_SEVERITY_DEBUG, fmt, tag, "DEBUG", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
+#define LOGINFO(tag, fmt, ...) ___LOG___(&log_library_default_logger, COLOR_GREEN, LOG_LIBRARY_SEVERITY_INFO, fmt, tag, "INFO", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
+#define LOGWARN(tag, fmt, ...) ___LOG___(&log_library_default_logger, COLOR_YELLOW, LOG_LIBRARY_SEVERITY_WARN, fmt, tag, "WARN", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
+#define LOGERROR(tag, fmt, ...) ___LOG___(&log_library_default_logger, COLOR_RED, LOG_LIBRARY_SEVERITY_ERROR, fmt, tag, "ERROR", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
+
+#define LOGDEBUG_L(logger, tag, fmt, ...) ___LOG___(logger, COLOR_BLUE, LOG_LIBRARY_SEVERITY_DEBUG, fmt, tag, "DEBUG", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
+#define LOGINFO_L(logger, tag, fmt, ...) ___LOG___(logger, COLOR_GREEN, LOG_LIBRARY_SEVERITY_INFO, fmt, tag, "INFO", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
+#define LOGWARN_L(logger, tag, fmt, ...) ___LOG___(logger, COLOR_YELLOW, LOG_LIBRARY_SEVERITY_WARN, fmt, tag, "WARN", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
+#define LOGERROR_L(logger, tag, fmt, ...) ___LOG___(logger, COLOR_RED, LOG_LIBRARY_SEVERITY_ERROR, fmt, tag, "ERROR", LOG_LIBRARY_SHORT_FILE, ##__VA_ARGS__)
+
+#define LOGDEBUG_HEX(tag, ptr, len) ___LOG_HEX___(&log_library_default_logger, COLOR_BLUE, LOG_LIBRARY_SEVERITY_DEBUG, tag, "DEBUG", LOG_LIBRARY_SHORT_FILE, ptr, len)
+#define LOGINFO_HEX(tag, ptr, len) ___LOG_HEX___(&log_library_default_logger, COLOR_GREEN, LOG_LIBRARY_SEVERITY_INFO, tag, "INFO", LOG_LIBRARY_SHORT_FILE, ptr, len)
+#define LOGWARN_HEX(tag, ptr, len) ___LOG_HEX___(&log_library_default_logger, COLOR_YELLOW, LOG_LIBRARY_SEVERITY_WARN, tag, "WARN", LOG_LIBRARY_SHORT_FILE, ptr, len)
+#define LOGERROR_HEX(tag, ptr, len) ___LOG_HEX___(&log_library_default_logger, COLOR_RED, LOG_LIBRARY_SEVERITY_ERROR, tag, "ERROR", LOG_LIBRARY_SHORT_FILE, ptr, len)
+
+#define LOGDEBUG_HEX_L(logger, tag, ptr, len) ___LOG_HEX___(logger, COLOR_BLUE, LOG_LIBRARY_SEVERITY_DEBUG, tag, "DEBUG", LOG_LIBRARY_SHORT_FILE, ptr, len)
+#define LOGINFO_HEX_L(logger, tag, ptr, len) ___LOG_HEX___(logger, COLOR_GREEN, LOG_LIBRARY_SEVERITY_INFO, tag, "INFO", LOG_LIBRARY_SHORT_FILE, ptr, len)
+#define LOGWARN_HEX_L(logger, tag, ptr, len) ___LOG_HEX___(logger, COLOR_YELLOW, LOG_LIBRARY_SEVERITY_WARN, tag, "WARN", LOG_LIBRARY_SHORT_FILE, ptr, len)
+#define LOGERROR_HEX_L(logger, tag, ptr, len) ___LOG_HEX___(logger, COLOR_RED, LOG_LIBRARY_SEVERITY_ERROR, tag, "ERROR", LOG_LIBRARY_SHORT_FILE, ptr, len)
+
+#endif
+
+#if defined(LOG_LIBRARY_LOG_LEVEL_ERROR)
+#undef LOGDEBUG
+#undef LOGINFO
+#undef LOGWARN
+#define LOGDEBUG(fmt, ...) ((void) 0)
+#define LOGINFO(fmt, ...) ((void) 0)
+#define LOGWARN(fmt, ...) ((void) 0)
+#undef LOGDEBUG_HEX
+#undef LOGINFO_HEX
+#undef LOGWARN_HEX
+#define LOGDEBUG_HEX(...) ((void) 0)
+#define LOGINFO_HEX(...) ((void) 0)
+#define LOGWARN_HEX(...) ((void) 0)
+#undef LOGDEBUG_L
+#undef LOGINFO_L
+#undef LOGWARN_L
+#define LOGDEBUG_L(...) ((void) 0)
+#define LOGINFO_L(...) ((void) 0)
+#define LOGWARN_L(...) ((void) 0)
+#undef LOGDEBUG_HEX_L
+#undef LOGINFO_HEX_L
+#undef LOGWARN_HEX_L
+#define LOGDEBUG_HEX_L(...) ((void) 0)
+#define LOGINFO_HEX_L(...) ((void) 0)
+#define LOGWARN_HEX_L(...) ((void) 0)
+#elif defined(LOG_LIBRARY_LOG_LEVEL_WARN)
+#undef LOGDEBUG
+#undef LOGINFO
+#define LOGDEBUG(fmt, ...) ((void) 0)
+#define LOGINFO(fmt, ...) ((void) 0)
+#undef LOGDEBUG_HEX
+#undef LOGINFO_HEX
+#define LOGDEBUG_HEX(...) ((void) 0)
+#define LOGINFO_HEX(...) ((void) 0)
+#undef LOGDEBUG_L
+#undef LOGINFO_L
+#define LOGDEBUG_L(...) ((void) 0)
+#define LOGINFO_L(...) ((void) 0)
+#undef LOGDEBUG_HEX_L
+#undef LOGINFO_HEX_L
+#define LOGDEBUG_HEX_L(...) ((void) 0)
+#define LOGINFO_HEX_L(...) ((void) 0)
+#elif defined(LOG_LIBRARY_LOG_LEVEL_DEBUG)
+#undef LOGINFO
+#define LOGINFO(fmt, ...) ((void) 0)
+#undef LOGINFO_HEX
+#define LOGINFO_HEX(...) ((void) 0)
+#undef LOGINFO_L
+#define LOGINFO_L(...) ((void) 0)
+#undef LOGINFO_HEX_L
+#define LOGINFO_HEX_L(...) ((void) 0)
+#elif defined(LOG_LIBRARY_LOG_LEVEL_INFO)
+#endif
+
+#ifdef __cplusplus
+#include <exception>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#if defined(__GLIBC__) || defined(__APPLE__)
+#define LOG_LIBRARY_EXECINFO
+#include <execinfo.h>
+#endif
+
+static inline const void SSTR(char *buffer, int size, unsigned int x) {
+  snprintf(buffer, size, "%u", x);
+}
+
+static inline const char *log_library_vform_exception(char *buffer, size_t buffer_size, const char *short_file, unsigned int line,
+                                                      const char *LOG_LIBRARY_func_name, const char *fmt, va_list argptr) {
+  char log_library_time_buffer[LOG_LIBRFARY_TIME_BUFFER_SIZE];
+  int written;
+
+  log_library_format_current_time(log_library_time_buffer, LOG_LIBRFARY_TIME_BUFFER_SIZE);
+#ifndef LOG_LIBRARY_LOG_SIMPLE
+  written = snprintf(buffer, buffer_size, "[EXCEPTION] %s [%s:%u] [%s] ",
+                     log_library_time_buffer, short_file, line, LOG_LIBRARY_func_name);
+#else
+  (void) short_file;
+  (void) line;
+  (void) LOG_LIBRARY_func_name;
+  written = snprintf(buffer, buffer_size, "[EXCEPTION] %s ", log_library_time_buffer);
+#endif
+  if (written >= 0 && (size_t) written < buffer_size) {
+    vsnprintf(buffer + written, buffer_size - written, fmt, argptr);
+  }
+  return buffer;
+}
+
+static inline std::string log_library_form_exception(const char *short_file, unsigned int line, const char *LOG_LIBRARY_func_name, const char *fmt, ...) {
+  char buffer[LOG_LIBRARY_EXCEPTION_BUFFER_SIZE];
+  va_list argptr;
+  va_start(argptr, fmt);
+  log_library_vform_exception(buffer, sizeof(buffer), short_file, line, LOG_LIBRARY_func_name, fmt, argptr);
+  va_end(argptr);
+  return std::string(buffer);
+}
+
+#if defined(_MSC_VER)
+#define LOG_LIBRARY_NOINLINE __declspec(noinline)
+#else
+#define LOG_LIBRARY_NOINLINE __attribute__((noinline))
+#endif
+
+// Exception with raw return addresses, frames are symbolized only when exception is logged.
+// Constructor is never inlined so the first frame is always its own, skip adds frames of helpers that call it.
+class log_library_exception : public std::runtime_error {
+public:
+  LOG_LIBRARY_NOINLINE explicit log_library_exception(const char *message, unsigned int skip = 0)
+      : std::runtime_error(message), frame_count_(0), frame_skip_(1 + skip) {
+#if defined(LOG_LIBRARY_EXECINFO)
+    int count = backtrace(frames_, LOG_LIBRARY_EXCEPTION_MAX_FRAMES);
+    frame_count_ = count > 0 ? (unsigned int) count : 0;
+#elif defined(_WIN32) || defined(_WIN64)
+    frame_count_ = CaptureStackBackTrace(0, LOG_LIBRARY_EXCEPTION_MAX_FRAMES, frames_, NULL);
+#endif
+  }
+
+  unsigned int frame_count() const { return frame_count_; }
+  unsigned int frame_skip() const { return frame_skip_; }
+  void *const *frames() const { return frames_; }
+
+private:
+  void *frames_[LOG_LIBRARY_EXCEPTION_MAX_FRAMES];
+  unsigned int frame_count_;
+  unsigned int frame_skip_;
+};
+
+// Formats exception message on the stack and returns exception with backtrace of the caller
+static inline LOG_LIBRARY_NOINLINE log_library_exception log_library_form_exception_bt(const char *short_file, unsigned int line, const char *LOG_LIBRARY_func_name,
+                                                                  const char *fmt, ...) {
+  char buffer[LOG_LIBRARY_EXCEPTION_BUFFER_SIZE];
+  va_list argptr;
+  va_start(argptr, fmt);
+  log_library_vform_exception(buffer, sizeof(buffer), short_file, line, LOG_LIBRARY_func_name, fmt, argptr);
+  va_end(argptr);
+  // Skip frame of this function
+  return log_library_exception(buffer, 1);
+}
+
+// Returns exception message and symbolized frames if exception has them
+static inline std::string log_library_exception_string(const std::exception &e) {
+  std::string result = e.what();
+  const log_library_exception *traced = dynamic_cast<const log_library_exception *>(&e);
+  if (!traced || traced->frame_count() == 0) {
+    return result;
+  }
+
+  char frame_buffer[LOG_LIBRARY_EXCEPTION_FRAME_SIZE];
+#if defined(LOG_LIBRARY_EXECINFO)
+  char **symbols = backtrace_symbols(traced->frames(), (int) traced->frame_count());
+#endif
+  // Frames of the exception constructor and EXCEPTION_BT helper are skipped, #0 is the throw site
+  for (unsigned int i = traced->frame_skip(); i < traced->frame_count(); i++) {
+#if defined(LOG_LIBRARY_EXECINFO)
+    if (symbols) {
+      snprintf(frame_buffer, sizeof(frame_buffer), "\n  #%u %s", i - traced->frame_skip(), symbols[i]);
+    } else
+#endif
+    {
+      snprintf(frame_buffer, sizeof(frame_buffer), "\n  #%u %p", i - traced->frame_skip(), traced->frames()[i]);
+    }
+    result += frame_buffer;
+  }
+#if defined(LOG_LIBRARY_EXECINFO)
+  free(symbols);
+#endif
+  return result;
+}
+
+// Pushes context pair for the lifetime of the scope
+class log_library_context_scope {
+public:
+  log_library_context_scope(const char *key, const char *fmt, ...) {
+    va_list argptr;
+    va_start(argptr, fmt);
+    log_library_context_vpush(key, fmt, argptr);
+    va_end(argptr);
+  }
+
+  ~log_library_context_scope() {
+    log_library_context_pop();
+  }
+
+private:
+  log_library_context_scope(const log_library_context_scope &);
+  log_library_context_scope &operator=(const log_library_context_scope &);
+};
+
+#define LOG_LIBRARY_CONCAT_IMPL(a, b) a##b
+#define LOG_LIBRARY_CONCAT(a, b) LOG_LIBRARY_CONCAT_IMPL(a, b)
+#define LOG_CONTEXT(key, fmt, ...) \
+  log_library_context_scope LOG_LIBRARY_CONCAT(log_library_context_scope_, LOG_LIBRARY_LINE)(key, fmt, ##__VA_ARGS__)
+
+#define EXCEPTION(fmt, ...) (log_library_form_exception(LOG_LIBRARY_SHORT_FILE, LOG_LIBRARY_LINE, LOG_LIBRARY_FUNC_NAME, fmt, ##__VA_ARGS__))
+#define EXCEPTION_BT(fmt, ...) (log_library_form_exception_bt(LOG_LIBRARY_SHORT_FILE, LOG_LIBRARY_LINE, LOG_LIBRARY_FUNC_NAME, fmt, ##__VA_ARGS__))
+
+#ifndef LOG_LIBRARY_TAG_SUPPORT
+#define LOG_EXCEPTION(e)                                                      \
+  do {                                                                        \
+    std::string log_library_exception_text = log_library_exception_string(e); \
+    LOGERROR("%s", log_library_exception_text.c_str());                       \
+  } while (0)
+#else
+#define LOG_EXCEPTION(tag, e)                                                 \
+  do {                                                                        \
+    std::string log_library_exception_text = log_library_exception_string(e); \
+    LOGERROR(tag, "%s", log_library_exception_text.c_str());                  \
+  } while (0)
+#endif
 
 #if (defined(_MSC_VER) && _MSC_VER >= 1900) || (defined(__cplusplus) && __cplusplus >= 201103L)
 
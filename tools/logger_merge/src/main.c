@@ -0,0 +1,39 @@
+#include "logger.h"
+
+// Merges shards written with log_library_set_sharded_log_file into one time ordered log
+int main(int argc, char **argv) {
+  log_library_merge *merge;
+  const char *record;
+  size_t size;
+  FILE *output = stdout;
+
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "Usage: %s <log file path> [output file]\n", argv[0]);
+    return 1;
+  }
+
+  merge = log_library_merge_open(argv[1]);
+  if (!merge) {
+    fprintf(stderr, "Can't open shards of %s\n", argv[1]);
+    return 1;
+  }
+
+  if (argc == 3) {
+    output = fopen(argv[2], "w");
+    if (!output) {
+      fprintf(stderr, "Can't open %s\n", argv[2]);
+      log_library_merge_close(merge);
+      return 1;
+    }
+  }
+
+  while ((record = log_library_merge_next(merge, &size)) != NULL) {
+    fwrite(record, 1, size, output);
+  }
+
+  log_library_merge_close(merge);
+  if (output != stdout) {
+    fclose(output);
+  }
+  return 0;
+}